@@ -0,0 +1,109 @@
+#ifndef AABB_H
+#define AABB_H
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <optional>
+
+#include "interval.h"
+#include "ray.h"
+#include "vec.h"
+
+// Reciprocal of a ray direction, precomputed once per ray for slab tests.
+struct RayInverse {
+  std::array<double, 3> origin;
+  std::array<double, 3> inv_dir;
+
+  explicit RayInverse(const Ray &ray)
+      : origin{ray.origin()[0], ray.origin()[1], ray.origin()[2]},
+        inv_dir{
+            1.0 / ray.direction()[0],
+            1.0 / ray.direction()[1],
+            1.0 / ray.direction()[2]
+        } {}
+};
+
+// Axis-aligned bounding box stored in single precision. Bounds built from
+// double precision points are rounded outward so the box stays conservative.
+struct AABB {
+  static constexpr float EMPTY = std::numeric_limits<float>::infinity();
+
+  std::array<float, 3> lo{EMPTY, EMPTY, EMPTY};
+  std::array<float, 3> hi{-EMPTY, -EMPTY, -EMPTY};
+
+  [[nodiscard]] static AABB from_points(const Point3 &a, const Point3 &b) {
+    AABB box;
+    for (size_t axis = 0; axis < 3; ++axis) {
+      box.lo[axis] = std::nextafter(
+          (float)std::min(a[axis], b[axis]), -std::numeric_limits<float>::max()
+      );
+      box.hi[axis] = std::nextafter(
+          (float)std::max(a[axis], b[axis]), std::numeric_limits<float>::max()
+      );
+    }
+    return box;
+  }
+
+  [[nodiscard]] bool empty() const noexcept { return lo[0] > hi[0]; }
+
+  void expand(const std::array<float, 3> &point) noexcept {
+    for (size_t axis = 0; axis < 3; ++axis) {
+      lo[axis] = std::min(lo[axis], point[axis]);
+      hi[axis] = std::max(hi[axis], point[axis]);
+    }
+  }
+
+  void expand(const AABB &other) noexcept {
+    for (size_t axis = 0; axis < 3; ++axis) {
+      lo[axis] = std::min(lo[axis], other.lo[axis]);
+      hi[axis] = std::max(hi[axis], other.hi[axis]);
+    }
+  }
+
+  [[nodiscard]] float centroid(size_t axis) const noexcept {
+    return 0.5F * (lo[axis] + hi[axis]);
+  }
+
+  [[nodiscard]] std::array<float, 3> centroid() const noexcept {
+    return {centroid(0), centroid(1), centroid(2)};
+  }
+
+  [[nodiscard]] size_t longest_axis() const noexcept {
+    std::array<float, 3> extent{hi[0] - lo[0], hi[1] - lo[1], hi[2] - lo[2]};
+    return (size_t)std::distance(
+        extent.begin(), std::ranges::max_element(extent)
+    );
+  }
+
+  [[nodiscard]] float surface_area() const noexcept {
+    if (empty())
+      return 0;
+    auto dx = hi[0] - lo[0], dy = hi[1] - lo[1], dz = hi[2] - lo[2];
+    return 2.0F * (dx * dy + dy * dz + dz * dx);
+  }
+
+  // Slab test. Returns the entry distance when the ray overlaps the box
+  // inside `ray_t`.
+  [[gnu::hot]] [[nodiscard]]
+  std::optional<double>
+  hit(const RayInverse &ray, Interval<double> ray_t) const noexcept {
+    auto tmin = ray_t.begin();
+    auto tmax = ray_t.end();
+    for (size_t axis = 0; axis < 3; ++axis) {
+      auto t0 = ((double)lo[axis] - ray.origin[axis]) * ray.inv_dir[axis];
+      auto t1 = ((double)hi[axis] - ray.origin[axis]) * ray.inv_dir[axis];
+      if (t0 > t1)
+        std::swap(t0, t1);
+      tmin = std::max(tmin, t0);
+      tmax = std::min(tmax, t1);
+    }
+    if (tmin > tmax)
+      return {};
+    return tmin;
+  }
+};
+
+#endif
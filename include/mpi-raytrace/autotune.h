@@ -0,0 +1,311 @@
+#ifndef AUTOTUNE_H
+#define AUTOTUNE_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <unistd.h>
+
+#include <fmt/format.h>
+
+#include "bvh.h"
+#include "camera.h"
+#include "numa.h"
+#include "view.h"
+
+// Picks the thread count and row scheduling of the threaded renderer by
+// timing short calibration renders, and remembers the winners per machine
+// and scene so later renders start from them.
+
+// Settings of the threaded renderer that do not change the image.
+struct RenderTuning {
+  size_t threads = 1;
+  size_t chunk_rows = 1;
+  RowSchedule schedule = RowSchedule::dynamic;
+
+  auto operator<=>(const RenderTuning &) const = default;
+};
+
+struct TuneResult {
+  RenderTuning tuning;
+  double pixels_per_second = 0; // At one ray per pixel.
+};
+
+// 64-bit FNV-1a over the pieces added to it.
+class Signature {
+  uint64_t hash = 0xcbf29ce484222325;
+
+public:
+  Signature &add(std::string_view bytes) {
+    for (auto byte : bytes) {
+      hash ^= (unsigned char)byte;
+      hash *= 0x100000001b3;
+    }
+    // Separate pieces so "ab", "c" and "a", "bc" differ.
+    hash ^= 0xff;
+    hash *= 0x100000001b3;
+    return *this;
+  }
+
+  Signature &add(uint64_t value) { return add(std::to_string(value)); }
+
+  [[nodiscard]] std::string hex() const { return fmt::format("{:016x}", hash); }
+};
+
+// Describes the CPUs this process may run on, so settings tuned on one
+// hardware generation are not applied to another.
+[[nodiscard]] inline std::string machine_signature(const NumaTopology &numa) {
+  std::string model = "unknown";
+  std::ifstream cpuinfo("/proc/cpuinfo");
+  for (std::string line; std::getline(cpuinfo, line);) {
+    if (!line.starts_with("model name"))
+      continue;
+    if (auto colon = line.find(':'); colon != std::string::npos)
+      model = line.substr(line.find_first_not_of(' ', colon + 1));
+    break;
+  }
+  std::ranges::replace(model, '\t', ' ');
+
+  size_t cpus = 0;
+  for (size_t node = 0; node < numa.node_count(); ++node)
+    cpus += numa.cpus(node).size();
+  return fmt::format(
+      "{}, {} cpus on {} nodes", model, cpus, numa.node_count()
+  );
+}
+
+// Identifies a render by its meshes, their sizes and modification times,
+// the resulting BVH and the image dimensions and bounce depth.
+[[nodiscard]] inline std::string scene_signature(
+    const std::vector<std::string> &mesh_paths, const BVH &world,
+    Vec2<size_t> dims, size_t max_bounces
+) {
+  Signature signature;
+  for (const auto &path : mesh_paths) {
+    std::error_code err;
+    auto size = std::filesystem::file_size(path, err);
+    auto modified = std::filesystem::last_write_time(path, err);
+    signature.add(path)
+        .add(err ? 0 : (uint64_t)size)
+        .add(err ? 0 : (uint64_t)modified.time_since_epoch().count());
+  }
+  signature.add(world.node_count())
+      .add(world.memory_bytes())
+      .add(dims[0])
+      .add(dims[1])
+      .add(max_bounces);
+  return signature.hex();
+}
+
+// Tuned settings stored as tab separated lines of machine, scene, threads,
+// rows per chunk, schedule and measured throughput.
+class TuneCache {
+  using Key = std::pair<std::string, std::string>; // Machine and scene.
+
+  std::filesystem::path path;
+  std::map<Key, TuneResult> entries;
+
+  [[nodiscard]] static std::optional<std::pair<Key, TuneResult>>
+  parse_line(const std::string &line) {
+    std::vector<std::string> fields;
+    std::istringstream stream(line);
+    for (std::string field; std::getline(stream, field, '\t');)
+      fields.push_back(std::move(field));
+    if (fields.size() != 6)
+      return {};
+    try {
+      TuneResult result{
+          {std::stoul(fields[2]),
+           std::stoul(fields[3]),
+           parse_row_schedule(fields[4])},
+          std::stod(fields[5])
+      };
+      if (result.tuning.threads == 0 || result.tuning.chunk_rows == 0)
+        return {};
+      return std::pair{Key{fields[0], fields[1]}, result};
+    } catch (const std::exception &) {
+      return {};
+    }
+  }
+
+public:
+  // Loads the cache at `path`. A missing file is an empty cache.
+  explicit TuneCache(std::filesystem::path path) : path(std::move(path)) {
+    std::ifstream file(this->path);
+    size_t number = 0;
+    for (std::string line; std::getline(file, line);) {
+      ++number;
+      if (line.empty() || line.starts_with('#'))
+        continue;
+      auto entry = parse_line(line);
+      if (!entry.has_value()) {
+        std::clog << fmt::format(
+            "Ignoring malformed line {} of {}.\n", number, this->path.string()
+        );
+        continue;
+      }
+      entries.insert_or_assign(entry->first, entry->second);
+    }
+  }
+
+  // `$XDG_CACHE_HOME/mpi-raytrace/tune.tsv`, falling back to `~/.cache`.
+  [[nodiscard]] static std::filesystem::path default_path() {
+    std::filesystem::path base;
+    if (const char *cache = std::getenv("XDG_CACHE_HOME");
+        cache != nullptr && *cache != '\0')
+      base = cache;
+    else if (const char *home = std::getenv("HOME"); home != nullptr)
+      base = std::filesystem::path(home) / ".cache";
+    return base / "mpi-raytrace" / "tune.tsv";
+  }
+
+  [[nodiscard]] const std::filesystem::path &file() const noexcept {
+    return path;
+  }
+
+  [[nodiscard]] std::optional<TuneResult>
+  find(const std::string &machine, const std::string &scene) const {
+    auto entry = entries.find({machine, scene});
+    if (entry == entries.end())
+      return {};
+    return entry->second;
+  }
+
+  void store(std::string machine, std::string scene, const TuneResult &result) {
+    entries.insert_or_assign({std::move(machine), std::move(scene)}, result);
+  }
+
+  // Writes the cache through a temporary file, so concurrent renders never
+  // read a partial one.
+  void save() const {
+    if (path.has_parent_path())
+      std::filesystem::create_directories(path.parent_path());
+    auto temporary = path;
+    temporary += fmt::format(".{}.tmp", ::getpid());
+    {
+      std::ofstream file(temporary);
+      if (!file)
+        throw std::runtime_error(fmt::format(
+            "Cannot write tuning cache '{}'.", temporary.string()
+        ));
+      file << "# machine\tscene\tthreads\tchunk_rows\tschedule\tpx_per_s\n";
+      for (const auto &[key, result] : entries)
+        file << fmt::format(
+            "{}\t{}\t{}\t{}\t{}\t{:.0f}\n",
+            key.first,
+            key.second,
+            result.tuning.threads,
+            result.tuning.chunk_rows,
+            to_string(result.tuning.schedule),
+            result.pixels_per_second
+        );
+    }
+    std::filesystem::rename(temporary, path);
+  }
+};
+
+// Times calibration renders of `world` at one ray per pixel and returns the
+// fastest settings. The calibration renders a horizontal band through the
+// middle of the frame, sized to the CPUs available, with the real bounce
+// depth. Starting from all CPUs, one row per chunk and the dynamic
+// schedule, thread count, chunk size and schedule are tuned one after
+// another. Threads are placed with `pin_policy`, as for the real render.
+[[nodiscard]] inline TuneResult autotune(
+    const Hittable &world, const NumaTopology &numa,
+    std::string_view pin_policy, Vec2<size_t> dims, size_t max_bounces,
+    const View &view = {}
+) {
+  constexpr size_t PIXELS_PER_CPU = size_t{1} << 14;
+  constexpr size_t MIN_PIXELS = size_t{1} << 17;
+  constexpr size_t RUNS = 2; // Best of, against timing noise.
+  // Speedup a candidate needs over the current best to replace it, so noise
+  // does not move the settings away from the defaults.
+  constexpr double MIN_GAIN = 1.02;
+
+  size_t cpus = 0;
+  for (size_t node = 0; node < numa.node_count(); ++node)
+    cpus += numa.cpus(node).size();
+  cpus = std::max<size_t>(cpus, 1);
+
+  Camera camera((double)dims[0], (double)dims[1], 1, max_bounces, view);
+  camera.show_progress(false);
+  dims = camera.dimensions();
+  auto rows = std::clamp<size_t>(
+      std::max(PIXELS_PER_CPU * cpus, MIN_PIXELS) / dims[0], 1, dims[1]
+  );
+  Region band{0, (dims[1] - rows) / 2, dims[0], rows};
+
+  std::map<RenderTuning, double> measured;
+  auto measure = [&](const RenderTuning &tuning) {
+    if (auto known = measured.find(tuning); known != measured.end())
+      return known->second;
+    ThreadPlacement placement(numa, pin_policy, tuning.threads);
+    camera.place_threads(&placement);
+    camera.schedule_rows(tuning.chunk_rows, tuning.schedule);
+    double best = 0;
+    for (size_t run = 0; run < RUNS; ++run) {
+      auto start = std::chrono::steady_clock::now();
+      (void)camera.render_region(world, tuning.threads, band);
+      std::chrono::duration<double> elapsed =
+          std::chrono::steady_clock::now() - start;
+      best = std::max(best, (double)(band.width * band.height) /
+                                elapsed.count());
+    }
+    camera.place_threads(nullptr);
+    std::clog << fmt::format(
+        "Tuning: {} threads, {} rows per chunk, {} schedule: {:.3g} px/s\n",
+        tuning.threads,
+        tuning.chunk_rows,
+        to_string(tuning.schedule),
+        best
+    );
+    measured.emplace(tuning, best);
+    return best;
+  };
+
+  // Warm caches and page in the scene before timing anything.
+  (void)camera.render_region(world, cpus, band);
+
+  RenderTuning defaults{cpus, 1, RowSchedule::dynamic};
+  TuneResult best{defaults, measure(defaults)};
+  auto consider = [&](const RenderTuning &tuning) {
+    auto speed = measure(tuning);
+    if (speed > best.pixels_per_second * MIN_GAIN)
+      best = {tuning, speed};
+  };
+
+  std::vector<size_t> thread_counts{cpus / 4, cpus / 2, cpus * 3 / 4, cpus};
+  std::erase(thread_counts, 0);
+  for (auto threads : thread_counts)
+    consider({threads, 1, RowSchedule::dynamic});
+
+  for (size_t chunk_rows : {1, 2, 4, 8, 16}) {
+    auto tuning = best.tuning;
+    tuning.chunk_rows = chunk_rows;
+    consider(tuning);
+  }
+
+  for (auto schedule : {RowSchedule::dynamic, RowSchedule::interleaved}) {
+    auto tuning = best.tuning;
+    tuning.schedule = schedule;
+    consider(tuning);
+  }
+
+  return best;
+}
+
+#endif
@@ -0,0 +1,86 @@
+#ifndef BOX_H
+#define BOX_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <optional>
+#include <utility>
+
+#include "aabb.h"
+#include "hittable.h"
+#include "interval.h"
+#include "material.h"
+#include "ray.h"
+#include "vec.h"
+
+// A solid axis-aligned box between two corners.
+class Box : public Hittable {
+  Point3 box_lo, box_hi;
+  Material box_material;
+
+public:
+  Box(const Point3 &a, const Point3 &b, Material material = {})
+      : box_lo(blaze::min(a, b)), box_hi(blaze::max(a, b)),
+        box_material(std::move(material)) {}
+
+  [[nodiscard]] const Point3 &lo() const noexcept { return box_lo; }
+  [[nodiscard]] const Point3 &hi() const noexcept { return box_hi; }
+  [[nodiscard]] const Material &material() const noexcept {
+    return box_material;
+  }
+
+  // Slab test that remembers which face the ray enters and leaves through.
+  // Rays starting inside the box hit the face they leave through.
+  [[gnu::hot]] [[nodiscard]]
+  static std::optional<HitRecord> intersect(
+      const Point3 &lo, const Point3 &hi, const Ray &ray,
+      Interval<double> ray_t
+  ) {
+    auto t_near = -infinity, t_far = infinity;
+    size_t near_axis = 0, far_axis = 0;
+    for (size_t axis = 0; axis < 3; ++axis) {
+      auto inv_dir = 1.0 / ray.direction()[axis];
+      auto t0 = (lo[axis] - ray.origin()[axis]) * inv_dir;
+      auto t1 = (hi[axis] - ray.origin()[axis]) * inv_dir;
+      if (t0 > t1)
+        std::swap(t0, t1);
+      if (t0 > t_near) {
+        t_near = t0;
+        near_axis = axis;
+      }
+      if (t1 < t_far) {
+        t_far = t1;
+        far_axis = axis;
+      }
+    }
+    if (t_near > t_far)
+      return {};
+
+    auto entering = ray_t.surrounds(t_near);
+    if (!entering && !ray_t.surrounds(t_far))
+      return {};
+    auto axis = entering ? near_axis : far_axis;
+    // Entering, the face looks against the ray; leaving, along it.
+    auto side = std::copysign(1.0, ray.direction()[axis]);
+    Vec3 outward_normal{0, 0, 0};
+    outward_normal[axis] = entering ? -side : side;
+    return HitRecord::from_face_normal(
+        ray, entering ? t_near : t_far, outward_normal
+    );
+  }
+
+  [[nodiscard]] std::optional<HitRecord>
+  hit(const Ray &ray, Interval<double> ray_t) const override {
+    auto record = intersect(box_lo, box_hi, ray, ray_t);
+    if (record.has_value())
+      record->material = &box_material;
+    return record;
+  }
+
+  [[nodiscard]] std::optional<AABB> bounding_box() const override {
+    return AABB::from_points(box_lo, box_hi);
+  }
+};
+
+#endif
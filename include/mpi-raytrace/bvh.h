@@ -0,0 +1,100 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "aabb.h"
+#include "compact_bvh.h"
+#include "hittable.h"
+#include "hittable_list.h"
+#include "interval.h"
+#include "ray.h"
+
+// Accelerates hit testing over the objects of a `HittableList`. Bounded
+// objects go into a `CompactBVH`; unbounded objects would make every node
+// cover everything, so they are kept aside and tested on every ray.
+class BVH : public Hittable {
+  std::vector<std::unique_ptr<Hittable>> objects; // In leaf order.
+  std::vector<std::unique_ptr<Hittable>> unbounded;
+  CompactBVH<> tree;
+
+public:
+  explicit BVH(HittableList &&list) {
+    std::vector<std::unique_ptr<Hittable>> bounded;
+    std::vector<AABB> bounds;
+    for (auto &object : list.objects) {
+      auto box = object->bounding_box();
+      if (box.has_value()) {
+        bounds.push_back(*box);
+        bounded.push_back(std::move(object));
+      } else {
+        unbounded.push_back(std::move(object));
+      }
+    }
+    list.clear();
+
+    std::vector<uint32_t> order;
+    tree = CompactBVH<>(bounds, order);
+    objects.reserve(order.size());
+    for (auto index : order)
+      objects.push_back(std::move(bounded[index]));
+  }
+
+  [[nodiscard]] size_t node_count() const noexcept {
+    return tree.node_count();
+  }
+  [[nodiscard]] size_t memory_bytes() const noexcept {
+    return tree.memory_bytes();
+  }
+
+  [[nodiscard]] std::optional<HitRecord>
+  hit(const Ray &ray, Interval<double> ray_t) const override {
+    std::optional<HitRecord> result;
+    auto closest_so_far = ray_t.end();
+
+    for (const auto &object : unbounded) {
+      auto record = object->hit(ray, Interval(ray_t.begin(), closest_so_far));
+      if (record.has_value()) {
+        closest_so_far = record->time;
+        result = std::move(*record);
+      }
+    }
+
+    tree.traverse(
+        ray,
+        Interval(ray_t.begin(), closest_so_far),
+        [&](uint32_t first, uint32_t count, double &closest) {
+          for (auto i = first; i < first + count; ++i) {
+            auto record =
+                objects[i]->hit(ray, Interval(ray_t.begin(), closest));
+            if (record.has_value()) {
+              closest = record->time;
+              result = std::move(*record);
+            }
+          }
+        }
+    );
+
+    return result;
+  }
+
+  void collect_lights(Lights &lights) const override {
+    for (const auto &object : unbounded)
+      object->collect_lights(lights);
+    for (const auto &object : objects)
+      object->collect_lights(lights);
+  }
+
+  [[nodiscard]] std::optional<AABB> bounding_box() const override {
+    if (!unbounded.empty())
+      return {};
+    return tree.bounds();
+  }
+};
+
+#endif
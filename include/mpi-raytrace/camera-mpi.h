@@ -1,26 +1,47 @@
 #ifndef CAMERA_H
 #define CAMERA_H
 
+#include <algorithm>
+#include <array>
+#include <chrono>
 #include <cstddef>
+#include <cstdint>
 #include <iostream>
+#include <limits>
+#include <optional>
 #include <ostream>
+#include <span>
+#include <utility>
 #include <vector>
 
 #include <mpi.h>
 
+#include <fmt/format.h>
+
 #include "color.h"
 #include "hittable.h"
 #include "interval.h"
+#include "mpi_chunked.h"
 #include "ray.h"
+#include "render_kernels.h"
+#include "resolve.h"
+#include "sample_accumulator.h"
+#include "trace.h"
 #include "utility.h"
 #include "vec.h"
 
 class Camera {
-  double aspect_ratio;          // Ratio of image width and height
+  // Pixels rank 0 receives and writes at a time while streaming the frame.
+  static constexpr size_t STREAM_BAND_PIXELS = size_t{1} << 22;
+
   Vec2<size_t> img_dims;        // Rendered image dimensions
   size_t rays_per_pixel;        // Anti-aliasing sample count for each pixel
   double pixel_samples_scale{}; // Color scale factor for a sum of pixel samples
   size_t max_bounces;           // The max times rays can bounce in the scene
+  ResolveOptions resolve_options; // Output encoding
+  // Render passes until this much time has passed instead of a fixed count.
+  std::optional<std::chrono::nanoseconds> time_budget;
+  bool reordering = false; // Trace with `render_chunk_reordered`.
 
   Point3 camera_center; // Camera center
   Point3 pixel00_loc;   // Location of pixel 0, 0
@@ -82,59 +103,36 @@ class Camera {
     return {ray_origin, Vec3(ray_direction)};
   }
 
-  [[nodiscard]]
-  // NOLINTNEXTLINE(misc-no-recursion) - OK because of musttail
-  static Color ray_color_helper(
-      const Ray &ray, size_t depth, const Hittable &world, double attenuation
-  ) {
-    constexpr auto EPSILON = 0.001; // shadow acne fix
-
-    if (depth <= 0)
-      return Color{0, 0, 0};
+  using ChunkKernel = void (Camera::*)(
+      const Hittable &, const Lights &, Interval<size_t>, size_t,
+      std::vector<std::vector<Color>> &
+  );
 
-    auto rec = world.hit(ray, Interval(EPSILON, infinity));
-
-    if (rec.has_value()) {
-      Vec3 direction = Vec3(rec->normal + Vec3::random_unit());
-
-      [[clang::musttail]] return ray_color_helper(
-          Ray(rec->point, direction), depth - 1, world, attenuation * 0.7
-      );
+  // Produces `render_chunk_fixed` instantiations for `kernels::table`.
+  struct MakeChunkKernel {
+    template <size_t Samples, size_t Bounces>
+    static constexpr ChunkKernel kernel() {
+      return &Camera::render_chunk_fixed<Samples, Bounces>;
     }
+  };
 
-    Vec3 unit_direction = Vec3(blaze::normalize(ray.direction()));
-    auto coeff_a = 0.5 * (unit_direction.y() + 1.0);
-    return Color{
-        (1.0 - coeff_a) * Color{1.0, 1.0, 1.0} + coeff_a * Color{0.5, 0.7, 1.0}
-    };
-  }
-
-  // Trace a ray through a world with a maximum depth.
-  [[nodiscard]] static Color
-  ray_color(const Ray &ray, size_t depth, const Hittable &world) {
-    return ray_color_helper(ray, depth, world, 1.0);
-  }
+  ChunkKernel chunk_kernel = &Camera::render_chunk_generic;
 
-public:
-  Camera(
-      double image_width, double image_height, size_t samples_per_pixel,
-      size_t max_bounces
-  )
-      : aspect_ratio(image_width / image_height),
-        rays_per_pixel(samples_per_pixel), max_bounces(max_bounces) {
-    img_dims = blaze::max(
-        Vec2<size_t>{
-            (size_t)(image_height), (size_t)(image_height / aspect_ratio)
-        },
-        1U
-    );
-
-    initialize();
+  // Picks the specialized kernel for this camera's settings, if one exists.
+  void select_kernel() {
+    if (reordering) {
+      chunk_kernel = &Camera::render_chunk_reordered;
+      return;
+    }
+    static constexpr auto KERNELS = kernels::table<MakeChunkKernel>();
+    auto index = kernels::index(rays_per_pixel, max_bounces);
+    chunk_kernel =
+        index.has_value() ? KERNELS[*index] : &Camera::render_chunk_generic;
   }
 
-  // Entrypoint for processes.
-  void render_chunk(
-      const Hittable &world, Interval<size_t> work_interval, size_t width,
+  void render_chunk_generic(
+      const Hittable &world, const Lights &lights,
+      Interval<size_t> work_interval, size_t width,
       std::vector<std::vector<Color>> &image
   ) {
     auto start_row = work_interval.begin();
@@ -150,7 +148,7 @@ public:
         Color pixel_color{0, 0, 0};
         for (size_t sample = 0; sample < rays_per_pixel; ++sample) {
           Ray ray = get_ray(current_width, current_height);
-          pixel_color += ray_color(ray, max_bounces, world);
+          pixel_color += kernels::ray_color(ray, max_bounces, world, lights);
         }
         // Store the result
         image[local_row][current_width] =
@@ -159,10 +157,163 @@ public:
     }
   }
 
-  // Renders a `world` through this camera.
-  void render(const Hittable &world) {
-    MPI_Init(nullptr, nullptr);
+  // `render_chunk_generic` with the sample count and bounce depth fixed at
+  // compile time.
+  template <size_t Samples, size_t Bounces>
+  void render_chunk_fixed(
+      const Hittable &world, const Lights &lights,
+      Interval<size_t> work_interval, size_t width,
+      std::vector<std::vector<Color>> &image
+  ) {
+    constexpr double SCALE = 1.0 / (double)Samples;
+    auto start_row = work_interval.begin();
+    size_t local_height = work_interval.end() - start_row;
+
+    for (size_t local_row = 0; local_row < local_height; ++local_row) {
+      size_t current_height = start_row + local_row;
+      for (size_t current_width = 0; current_width < width; ++current_width) {
+        Color pixel_color{0, 0, 0};
+        for (size_t sample = 0; sample < Samples; ++sample) {
+          Ray ray = get_ray(current_width, current_height);
+          pixel_color +=
+              kernels::ray_color_fixed<Bounces>(ray, world, lights);
+        }
+        image[local_row][current_width] = Color(pixel_color * SCALE);
+      }
+    }
+  }
+
+  // `render_chunk_generic`, but tracing the paths of as many rows at a time
+  // as fit in `kernels::REORDER_BATCH` with `kernels::trace_reordered`.
+  void render_chunk_reordered(
+      const Hittable &world, const Lights &lights,
+      Interval<size_t> work_interval, size_t width,
+      std::vector<std::vector<Color>> &image
+  ) {
+    std::vector<kernels::PathState> paths;
+    std::vector<Color> radiance;
+    auto start_row = work_interval.begin();
+    const size_t batch_rows =
+        std::max<size_t>(1, kernels::REORDER_BATCH / (width * rays_per_pixel));
+
+    for (auto batch = start_row; batch < work_interval.end();
+         batch += batch_rows) {
+      auto batch_end = std::min(batch + batch_rows, work_interval.end());
+      paths.clear();
+      for (auto row = batch; row < batch_end; ++row)
+        for (size_t col = 0; col < width; ++col)
+          for (size_t sample = 0; sample < rays_per_pixel; ++sample)
+            paths.push_back({get_ray(col, row)});
+      radiance.assign(paths.size(), Color{0, 0, 0});
+
+      kernels::trace_reordered(paths, max_bounces, world, lights, radiance);
+
+      auto path = radiance.begin();
+      for (auto row = batch; row < batch_end; ++row)
+        for (size_t col = 0; col < width; ++col) {
+          Color pixel_color{0, 0, 0};
+          for (size_t sample = 0; sample < rays_per_pixel; ++sample)
+            pixel_color += *path++;
+          image[row - start_row][col] =
+              Color(pixel_color * pixel_samples_scale);
+        }
+    }
+  }
+
+public:
+  Camera(
+      double image_width, double image_height, size_t samples_per_pixel,
+      size_t max_bounces
+  )
+      : rays_per_pixel(samples_per_pixel), max_bounces(max_bounces) {
+    img_dims = blaze::max(
+        Vec2<size_t>{(size_t)image_width, (size_t)image_height}, 1U
+    );
+
+    initialize();
+    select_kernel();
+  }
+
+  // Encodes the output image with `options`.
+  void resolve_with(const ResolveOptions &options) noexcept {
+    resolve_options = options;
+  }
+
+  // Trace the paths of a block of rows a bounce at a time, reordering rays
+  // between bounces, see `kernels::trace_reordered`.
+  void reorder_rays() noexcept {
+    reordering = true;
+    select_kernel();
+  }
+
+  // Renders passes of one ray per pixel until `budget` has passed, instead
+  // of the fixed number of rays per pixel.
+  void render_for(std::chrono::nanoseconds budget) {
+    time_budget = budget;
+    rays_per_pixel = 1;
+    pixel_samples_scale = 1;
+    select_kernel();
+  }
+
+  // Adds passes over `count` rows, `first` and every `stride`th after it,
+  // until `deadline`, one row at a time, and returns them normalized by
+  // their sample counts. The first pass is always completed, so every pixel
+  // has a sample.
+  [[nodiscard]] std::vector<std::vector<Color>> render_chunk_until(
+      const Hittable &world, size_t first, size_t stride, size_t count,
+      size_t width, std::chrono::steady_clock::time_point deadline
+  ) {
+    Lights lights;
+    world.collect_lights(lights);
+
+    SampleAccumulator accumulator(count);
+    std::vector<std::vector<Color>> pass(1, std::vector<Color>(width));
+    bool expired = false;
+    for (size_t passes = 0; !expired && count > 0; ++passes)
+      for (size_t i = 0; i < count; ++i) {
+        expired =
+            passes > 0 && std::chrono::steady_clock::now() >= deadline;
+        if (expired)
+          break;
+        auto row = first + i * stride;
+        (this->*chunk_kernel)(
+            world, lights, Interval{row, row + 1}, width, pass
+        );
+        accumulator.add(i, pass[0], (uint32_t)rays_per_pixel);
+      }
+
+    // Report the sample counts over all ranks, ignoring ranks without rows.
+    auto [fewest, most] = accumulator.sample_range();
+    if (count == 0)
+      fewest = std::numeric_limits<uint32_t>::max();
+    uint32_t global_fewest{}, global_most{};
+    MPI_Reduce(
+        &fewest, &global_fewest, 1, MPI_UINT32_T, MPI_MIN, 0, MPI_COMM_WORLD
+    );
+    MPI_Reduce(
+        &most, &global_most, 1, MPI_UINT32_T, MPI_MAX, 0, MPI_COMM_WORLD
+    );
+    int rank{};
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    if (rank == 0)
+      std::clog << fmt::format(
+          "Traced {} to {} rays per pixel.\n", global_fewest, global_most
+      );
+    return std::move(accumulator).resolve();
+  }
+
+  // Entrypoint for processes.
+  void render_chunk(
+      const Hittable &world, Interval<size_t> work_interval, size_t width,
+      std::vector<std::vector<Color>> &image
+  ) {
+    Lights lights;
+    world.collect_lights(lights);
+    (this->*chunk_kernel)(world, lights, work_interval, width, image);
+  }
 
+  // Renders a `world` through this camera. MPI must be initialized.
+  void render(const Hittable &world) {
     int rank_{}, size_{};
     MPI_Comm_rank(MPI_COMM_WORLD, &rank_);
     MPI_Comm_size(MPI_COMM_WORLD, &size_);
@@ -176,106 +327,145 @@ public:
     size_t rows_per_process = height / size;
     size_t remainder_rows = height % size;
 
-    // Calculate work partition for self.
-    size_t start_row{}, end_row{};
-    if (rank < remainder_rows) {
-      start_row = rank * (rows_per_process + 1);
-      end_row = start_row + rows_per_process + 1;
-    } else {
-      start_row = rank * rows_per_process + remainder_rows;
-      end_row = start_row + rows_per_process;
-    }
-
-    size_t local_height = end_row - start_row;
+    // Rows of a process: its first row, the step to its next and its row
+    // count. Normally a contiguous block. With a time budget every `size`th
+    // row instead, so a pass costs every process about the same and all of
+    // them reach about as many samples per pixel, rather than processes with
+    // cheap rows sampling those many times more often.
+    const bool interleaved = time_budget.has_value();
+    auto rows_of = [&](size_t process) {
+      if (interleaved)
+        return std::array<size_t, 3>{
+            process,
+            size,
+            process < height ? (height - process - 1) / size + 1 : 0
+        };
+      if (process < remainder_rows)
+        return std::array<size_t, 3>{
+            process * (rows_per_process + 1), 1, rows_per_process + 1
+        };
+      return std::array<size_t, 3>{
+          process * rows_per_process + remainder_rows, 1, rows_per_process
+      };
+    };
+    // Local indices of the rows of `process` within image rows
+    // `[first, last)`.
+    auto local_rows = [&](size_t process, size_t first, size_t last) {
+      auto [start, stride, count] = rows_of(process);
+      auto index = [&](size_t row) -> size_t {
+        if (row <= start)
+          return 0;
+        return std::min((row - start + stride - 1) / stride, count);
+      };
+      return std::pair{index(first), index(last)};
+    };
+    auto [start_row, row_stride, local_height] = rows_of(rank);
 
     // Each process creates local image buffer
     std::vector<std::vector<Color>> local_image(
         local_height, std::vector<Color>(width)
     );
 
+    // Start the clock together so every rank stops at the same time.
+    if (time_budget.has_value())
+      MPI_Barrier(MPI_COMM_WORLD);
     auto start_time = std::chrono::steady_clock::now();
 
     // Each process renders its chunk
-    this->render_chunk(world, Interval{start_row, end_row}, width, local_image);
-
-    // Each process flattens local_image into send_buffer
-    size_t num_elements = local_height * width * 3;
-    std::vector<double> send_buffer(num_elements);
-
-    // Copy data from local_image to send_buffer
-    for (size_t i = 0; i < local_height; ++i) {
-      for (size_t j = 0; j < width; ++j) {
-        size_t idx = (i * width + j) * 3;
-        send_buffer[idx] = local_image[i][j].x();
-        send_buffer[idx + 1] = local_image[i][j].y();
-        send_buffer[idx + 2] = local_image[i][j].z();
-      }
-    }
-
-    // Rank 0 sets up receive buffer and counts/displacements
-    std::vector<int> recvcounts(size);
-    std::vector<int> displs(size);
-
-    size_t total_elements = height * width * 3;
-    std::vector<double> recv_buffer;
-
-    if (rank == 0) {
-      recv_buffer.resize(total_elements);
-    }
-
-    // Compute recvcounts and displs on all ranks
-    size_t offset = 0;
-    for (size_t i = 0; i < size; ++i) {
-      size_t proc_rows =
-          (i < remainder_rows) ? (rows_per_process + 1) : rows_per_process;
-      size_t proc_elements = proc_rows * width * 3;
-      recvcounts[i] = static_cast<int>(proc_elements);
-      displs[i] = static_cast<int>(offset);
-      offset += proc_elements;
+    if (time_budget.has_value()) {
+      TraceSpan span("render chunk");
+      local_image = render_chunk_until(
+          world,
+          start_row,
+          row_stride,
+          local_height,
+          width,
+          start_time + *time_budget
+      );
+    } else {
+      TraceSpan span("render chunk");
+      this->render_chunk(
+          world,
+          Interval{start_row, start_row + local_height},
+          width,
+          local_image
+      );
     }
 
-    // Now, gather data from all processes
-    MPI_Gatherv(
-        send_buffer.data(),
-        static_cast<int>(num_elements),
-        MPI_DOUBLE,
-        recv_buffer.data(),
-        recvcounts.data(),
-        displs.data(),
-        MPI_DOUBLE,
-        0,
-        MPI_COMM_WORLD
-    );
-
-    if (rank == 0) {
-      // After gathering, reconstruct the image
-      std::vector<std::vector<Color>> image(height, std::vector<Color>(width));
-
-      size_t idx = 0;
-      for (size_t i = 0; i < height; ++i) {
-        for (size_t j = 0; j < width; ++j) {
-          image[i][j] = Color{
-              recv_buffer[idx], recv_buffer[idx + 1], recv_buffer[idx + 2]
-          };
-          idx += 3;
+    // Stream the frame to rank 0 a band of rows at a time and write each
+    // band as it is complete. Every rank sends its rows of the band, if
+    // any, in one message. No rank holds more than its own rows and one
+    // band, and no message exceeds what MPI can count.
+    auto band_rows = std::max<size_t>(STREAM_BAND_PIXELS / width, 1);
+    std::vector<double> buffer;
+
+    if (rank != 0) {
+      for (size_t first = 0; first < height; first += band_rows) {
+        auto [lo, hi] =
+            local_rows(rank, first, std::min(first + band_rows, height));
+        if (lo == hi)
+          continue;
+        buffer.resize((hi - lo) * width * 3);
+        {
+          TraceSpan span("pack");
+          for (auto i = lo; i < hi; ++i)
+            for (size_t j = 0; j < width; ++j) {
+              size_t idx = ((i - lo) * width + j) * 3;
+              buffer[idx] = local_image[i][j].x();
+              buffer[idx + 1] = local_image[i][j].y();
+              buffer[idx + 2] = local_image[i][j].z();
+            }
         }
+        TraceSpan span("gather");
+        send_chunked<double>(buffer, MPI_DOUBLE, 0, 0, MPI_COMM_WORLD);
       }
+      return;
+    }
 
-      std::chrono::duration<double> elapsed =
-          std::chrono::steady_clock::now() - start_time;
+    write_image_header(std::cout, width, height, resolve_options);
+    std::vector<std::vector<Color>> band;
+    for (size_t first = 0; first < height; first += band_rows) {
+      auto last = std::min(first + band_rows, height);
+      band.resize(last - first);
+      for (size_t source = 0; source < size; ++source) {
+        auto [lo, hi] = local_rows(source, first, last);
+        if (lo == hi)
+          continue;
+        auto [source_start, source_stride, source_count] = rows_of(source);
+        auto band_row = [&](size_t i) -> auto & {
+          return band[source_start + i * source_stride - first];
+        };
+        if (source == 0) {
+          for (auto i = lo; i < hi; ++i)
+            band_row(i) = local_image[i];
+          continue;
+        }
 
-      // Output the image after all processes finish
-      std::cout << "P3\n" << width << ' ' << height << "\n255\n";
-      for (const auto &row : image) {
-        for (const auto &pixel : row) {
-          write_color(std::cout, pixel);
+        buffer.resize((hi - lo) * width * 3);
+        {
+          TraceSpan span("gather");
+          receive_chunked<double>(
+              buffer, MPI_DOUBLE, (int)source, 0, MPI_COMM_WORLD
+          );
+        }
+        TraceSpan span("unpack");
+        size_t idx = 0;
+        for (auto i = lo; i < hi; ++i) {
+          auto &row = band_row(i);
+          row.resize(width);
+          for (auto &pixel : row) {
+            pixel = Color{buffer[idx], buffer[idx + 1], buffer[idx + 2]};
+            idx += 3;
+          }
         }
       }
-
-      std::clog << "Done in " << elapsed.count() << " seconds.";
+      TraceSpan span("encode");
+      write_image_rows(std::cout, band, first, resolve_options);
     }
 
-    MPI_Finalize();
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start_time;
+    std::clog << "Done in " << elapsed.count() << " seconds.";
   }
 };
 
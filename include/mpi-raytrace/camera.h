@@ -8,19 +8,35 @@
 #include <functional>
 #include <future>
 #include <iostream>
+#include <mutex>
+#include <optional>
 #include <ostream>
 #include <ranges>
+#include <span>
 #include <stdexcept>
 #include <string>
+#include <string_view>
 #include <thread>
 #include <utility>
 #include <vector>
 
+#include <fmt/format.h>
+
 #include "color.h"
 #include "hittable.h"
 #include "interval.h"
+#include "live_framebuffer.h"
+#include "numa.h"
+#include "partial_image.h"
 #include "ray.h"
+#include "render_kernels.h"
+#include "resolve.h"
+#include "sample_accumulator.h"
+#include "thread_pool.h"
+#include "trace.h"
+#include "utility.h"
 #include "vec.h"
+#include "view.h"
 
 #ifdef __cpp_lib_hardware_interference_size
 using std::hardware_constructive_interference_size;
@@ -31,14 +47,43 @@ constexpr std::size_t hardware_constructive_interference_size = 64;
 constexpr std::size_t hardware_destructive_interference_size = 64;
 #endif
 
+// How render threads split the rows of a region between them.
+enum class RowSchedule {
+  dynamic,     // Threads claim the next chunk from a shared counter.
+  interleaved, // Thread `i` of `n` renders chunks `i`, `i + n`, ...
+};
+
+[[nodiscard]] inline RowSchedule parse_row_schedule(std::string_view name) {
+  if (name == "dynamic")
+    return RowSchedule::dynamic;
+  if (name == "interleaved")
+    return RowSchedule::interleaved;
+  throw std::invalid_argument(fmt::format(
+      "Unknown row schedule '{}', expected dynamic or interleaved.", name
+  ));
+}
+
+[[nodiscard]] constexpr std::string_view to_string(RowSchedule schedule) {
+  return schedule == RowSchedule::dynamic ? "dynamic" : "interleaved";
+}
+
 class Camera {
   alignas(hardware_destructive_interference_size
   ) std::atomic<size_t> rows_completed = 0; // Counter for render progress
-  double aspect_ratio;                      // Ratio of image width and height
   Vec2<size_t> img_dims;                    // Rendered image dimensions
   size_t rays_per_pixel;        // Anti-aliasing sample count for each pixel
   double pixel_samples_scale{}; // Color scale factor for a sum of pixel samples
   size_t max_bounces;           // The max times rays can bounce in the scene
+  View view;                    // Camera position and orientation
+  LiveFramebuffer *live_framebuffer = nullptr; // Optional progress output
+  const ThreadPlacement *placement = nullptr;  // Optional thread pinning
+  ResolveOptions resolve_options;              // Output encoding
+  size_t chunk_rows = 1;                       // Rows a thread renders at once
+  RowSchedule row_schedule = RowSchedule::dynamic;
+  bool progress_bar = true;
+  bool reordering = false; // Trace with `render_rows_reordered`.
+  // Render passes until this much time has passed instead of a fixed count.
+  std::optional<std::chrono::nanoseconds> time_budget;
 
   Point3 camera_center; // Camera center
   Point3 pixel00_loc;   // Location of pixel 0, 0
@@ -46,8 +91,10 @@ class Camera {
   Vec3 pixel_delta_v;   // Offset to pixel below
 
   void initialize() {
-    auto focal_length = 1.0;
-    auto viewport_h = 2.0; // 2 is arbitrary, can be any number
+    auto look_dir = Vec3(view.look_from - view.look_at);
+    auto focal_length = blaze::norm(look_dir);
+    auto viewport_h =
+        2.0 * std::tan(degrees_to_radians(view.vfov) / 2) * focal_length;
 
     pixel_samples_scale = 1.0 / (double)rays_per_pixel;
 
@@ -55,12 +102,17 @@ class Camera {
         viewport_h * (double(img_dims[0]) / double(img_dims[1])), viewport_h
     };
 
-    camera_center = Point3({0, 0, 0});
+    camera_center = view.look_from;
+
+    // Orthonormal camera basis: `w` points backwards, `u` right and `v` up.
+    auto w = Vec3(look_dir / focal_length);
+    auto u = Vec3(blaze::normalize(blaze::cross(view.up, w)));
+    auto v = Vec3(blaze::cross(w, u));
 
     // Calculate the vectors across the horizontal and down the vertical
     // viewport edges.
-    auto viewport_u = Vec3{viewport_dims[0], 0, 0};
-    auto viewport_v = Vec3{0, -viewport_dims[1], 0};
+    auto viewport_u = Vec3(viewport_dims[0] * u);
+    auto viewport_v = Vec3(-viewport_dims[1] * v);
 
     // Calculate the horizontal and vertical delta vectors from pixel to pixel.
     pixel_delta_u = Vec3{viewport_u / (double)img_dims[0]};
@@ -68,8 +120,7 @@ class Camera {
 
     // Calculate the location of the upper left pixel.
     auto viewport_upper_left = Vec3{
-        camera_center - Vec3{0, 0, focal_length} - viewport_u / 2 -
-        viewport_v / 2
+        camera_center - focal_length * w - viewport_u / 2 - viewport_v / 2
     };
 
     pixel00_loc =
@@ -101,69 +152,194 @@ class Camera {
     return {ray_origin, ray_direction};
   }
 
-  [[nodiscard]]
-  static Color ray_color_helper(
-      const Ray &ray, size_t depth, const Hittable &world, double attenuation
-  ) {
-    constexpr auto EPSILON = 0.001; // shadow acne fix
+  using RowKernel = void (Camera::*)(
+      const Hittable &, const Lights &, const Region &, size_t, size_t,
+      std::vector<std::vector<Color>> &
+  );
 
-    if (depth == 0)
-      return Color{0, 0, 0};
+  // Produces `render_rows_fixed` instantiations for `kernels::table`.
+  struct MakeRowKernel {
+    template <size_t Samples, size_t Bounces>
+    static constexpr RowKernel kernel() {
+      return &Camera::render_rows_fixed<Samples, Bounces>;
+    }
+  };
 
-    auto rec = world.hit(ray, Interval(EPSILON, infinity));
+  RowKernel row_kernel = &Camera::render_rows_generic;
 
-    if (rec.has_value()) {
-      Vec3 direction = Vec3(rec->normal + Vec3::random_unit());
-      [[clang::musttail]] return ray_color_helper(
-          Ray(rec->point, direction), depth - 1, world, attenuation * 0.7
-      );
+  // Picks the specialized kernel for this camera's settings, if one exists.
+  void select_kernel() {
+    if (reordering) {
+      row_kernel = &Camera::render_rows_reordered;
+      return;
     }
+    static constexpr auto KERNELS = kernels::table<MakeRowKernel>();
+    auto index = kernels::index(rays_per_pixel, max_bounces);
+    row_kernel =
+        index.has_value() ? KERNELS[*index] : &Camera::render_rows_generic;
+  }
 
-    Vec3 unit_direction = Vec3{blaze::normalize(ray.direction())};
-    auto coeff_a = 0.5 * (unit_direction.y() + 1.0);
-    return Color{
-        (1.0 - coeff_a) * Color{1.0, 1.0, 1.0} + coeff_a * Color{0.5, 0.7, 1.0}
-    };
+  [[gnu::hot]] void render_rows_generic(
+      const Hittable &world, const Lights &lights, const Region &region,
+      size_t first, size_t last, std::vector<std::vector<Color>> &image
+  ) {
+    // Go through each pixel in the image one by one,
+    // generate a random ray that originates from the pixel,
+    // and trace it.
+    for (size_t row = first; row < last; ++row) {
+      for (size_t col = 0; col < region.width; ++col) {
+        Color pixel_color{0, 0, 0};
+        for (size_t sample = 0; sample < rays_per_pixel; ++sample) {
+          Ray ray = get_ray(region.x + col, region.y + row);
+          pixel_color += kernels::ray_color(ray, max_bounces, world, lights);
+        }
+        // Store the result
+        image[row][col] = Color{pixel_color * pixel_samples_scale};
+      }
+    }
   }
 
-  // Trace a ray through a world with a maximum depth.
-  [[gnu::hot]] [[nodiscard]]
-  static Color ray_color(const Ray &ray, size_t depth, const Hittable &world) {
-    return ray_color_helper(ray, depth, world, 1.0);
+  // `render_rows_generic` with the sample count and bounce depth fixed at
+  // compile time.
+  template <size_t Samples, size_t Bounces>
+  [[gnu::hot]] void render_rows_fixed(
+      const Hittable &world, const Lights &lights, const Region &region,
+      size_t first, size_t last, std::vector<std::vector<Color>> &image
+  ) {
+    constexpr double SCALE = 1.0 / (double)Samples;
+    for (size_t row = first; row < last; ++row) {
+      for (size_t col = 0; col < region.width; ++col) {
+        Color pixel_color{0, 0, 0};
+        for (size_t sample = 0; sample < Samples; ++sample) {
+          Ray ray = get_ray(region.x + col, region.y + row);
+          pixel_color +=
+              kernels::ray_color_fixed<Bounces>(ray, world, lights);
+        }
+        image[row][col] = Color{pixel_color * SCALE};
+      }
+    }
+  }
+
+  // `render_rows_generic`, but tracing the paths of as many rows at a time
+  // as fit in `kernels::REORDER_BATCH` with `kernels::trace_reordered`.
+  [[gnu::hot]] void render_rows_reordered(
+      const Hittable &world, const Lights &lights, const Region &region,
+      size_t first, size_t last, std::vector<std::vector<Color>> &image
+  ) {
+    thread_local std::vector<kernels::PathState> paths;
+    thread_local std::vector<Color> radiance;
+    const size_t row_paths = region.width * rays_per_pixel;
+    const size_t batch_rows =
+        std::max<size_t>(1, kernels::REORDER_BATCH / row_paths);
+
+    for (size_t batch = first; batch < last; batch += batch_rows) {
+      auto batch_end = std::min(batch + batch_rows, last);
+      paths.clear();
+      for (size_t row = batch; row < batch_end; ++row)
+        for (size_t col = 0; col < region.width; ++col)
+          for (size_t sample = 0; sample < rays_per_pixel; ++sample)
+            paths.push_back({get_ray(region.x + col, region.y + row)});
+      radiance.assign(paths.size(), Color{0, 0, 0});
+
+      kernels::trace_reordered(paths, max_bounces, world, lights, radiance);
+
+      auto path = radiance.begin();
+      for (size_t row = batch; row < batch_end; ++row)
+        for (size_t col = 0; col < region.width; ++col) {
+          Color pixel_color{0, 0, 0};
+          for (size_t sample = 0; sample < rays_per_pixel; ++sample)
+            pixel_color += *path++;
+          image[row][col] = Color{pixel_color * pixel_samples_scale};
+        }
+    }
   }
 
-  // This function now continuously obtains work in 256-row chunks
-  // until all rows are processed.
+  // Renders chunks of `chunk_rows` rows, picked by `row_schedule`, until
+  // all rows are processed.
   void render_thread(
-      const Hittable &world, size_t width, size_t height,
-      std::atomic<size_t> &next_row, std::vector<std::vector<Color>> &image
+      const Hittable &world, const Region &region, size_t thread_idx,
+      size_t total_threads, std::atomic<size_t> &next_row,
+      std::vector<std::vector<Color>> &image
+  ) {
+    Lights lights;
+    world.collect_lights(lights);
+
+    for (size_t claimed = 0;; ++claimed) {
+      size_t start =
+          row_schedule == RowSchedule::dynamic
+              ? next_row.fetch_add(chunk_rows, std::memory_order_acq_rel)
+              : (thread_idx + claimed * total_threads) * chunk_rows;
+      if (start >= region.height)
+        break;
+      size_t end = std::min(start + chunk_rows, region.height);
+
+      // Allocate rows on the thread that renders them so their pages are
+      // first touched, and placed, on this thread's NUMA node.
+      for (size_t row = start; row < end; ++row)
+        image[row].resize(region.width);
+
+      {
+        TraceSpan span("render rows");
+        (this->*row_kernel)(world, lights, region, start, end, image);
+      }
+
+      if (live_framebuffer != nullptr) {
+        TraceSpan span("publish rows");
+        for (size_t row = start; row < end; ++row)
+          live_framebuffer->publish_row(
+              region.x, region.y + row, image[row], (uint32_t)rays_per_pixel
+          );
+      }
+
+      // Update progress after finishing a row for progress bar.
+      rows_completed.fetch_add(end - start, std::memory_order_acq_rel);
+    }
+  }
+
+  // Adds passes of one ray per pixel over `region` to `accumulator` until
+  // `deadline`. Chunks of every pass are claimed in order from `next_chunk`
+  // and added under their lock in `chunk_locks`. The first pass is always
+  // completed, so every pixel has a sample.
+  void render_thread_until(
+      const Hittable &world, const Region &region,
+      std::chrono::steady_clock::time_point deadline,
+      std::atomic<size_t> &next_chunk, std::span<std::mutex> chunk_locks,
+      SampleAccumulator &accumulator
   ) {
-    constexpr size_t CHUNK_SIZE = 1;
+    Lights lights;
+    world.collect_lights(lights);
 
+    const size_t chunks = chunk_locks.size();
+    std::vector<std::vector<Color>> pass(
+        chunk_rows, std::vector<Color>(region.width)
+    );
     for (;;) {
-      size_t start = next_row.fetch_add(CHUNK_SIZE, std::memory_order_acq_rel);
-      if (start >= height)
+      auto claimed = next_chunk.fetch_add(1, std::memory_order_acq_rel);
+      if (claimed >= chunks && std::chrono::steady_clock::now() >= deadline)
         break;
-      size_t end = std::min(start + CHUNK_SIZE, height);
-
-      // Go through each pixel in the image one by one,
-      // generate a random ray that originates from the pixel,
-      // and trace it.
-      for (size_t current_height = start; current_height < end;
-           ++current_height) {
-        for (size_t current_width = 0; current_width < width; ++current_width) {
-          Color pixel_color{0, 0, 0};
-          for (size_t sample = 0; sample < rays_per_pixel; ++sample) {
-            Ray ray = get_ray(current_width, current_height);
-            pixel_color += ray_color(ray, max_bounces, world);
-          }
-          // Store the result
-          image[current_height][current_width] =
-              Color{pixel_color * pixel_samples_scale};
-        }
+      auto chunk = claimed % chunks;
+      size_t start = chunk * chunk_rows;
+      size_t end = std::min(start + chunk_rows, region.height);
+
+      {
+        TraceSpan span("render rows");
+        Region rows{region.x, region.y + start, region.width, end - start};
+        (this->*row_kernel)(world, lights, rows, 0, end - start, pass);
       }
 
-      // Update progress after finishing a row for progress bar.
+      std::scoped_lock lock(chunk_locks[chunk]);
+      for (size_t row = start; row < end; ++row)
+        accumulator.add(row, pass[row - start], (uint32_t)rays_per_pixel);
+      if (live_framebuffer != nullptr) {
+        TraceSpan span("publish rows");
+        for (size_t row = start; row < end; ++row)
+          live_framebuffer->publish_row(
+              region.x,
+              region.y + row,
+              accumulator.mean(row),
+              accumulator.samples(row)
+          );
+      }
       rows_completed.fetch_add(end - start, std::memory_order_acq_rel);
     }
   }
@@ -171,62 +347,181 @@ class Camera {
 public:
   Camera(
       double image_width, double image_height, size_t samples_per_pixel,
-      size_t max_bounces
+      size_t max_bounces, View view = {}
   )
-      : aspect_ratio(image_width / image_height),
-        rays_per_pixel(samples_per_pixel), max_bounces(max_bounces) {
+      : rays_per_pixel(samples_per_pixel), max_bounces(max_bounces),
+        view(std::move(view)) {
     img_dims = blaze::max(
-        Vec2<size_t>{
-            (size_t)(image_height), (size_t)(image_height / aspect_ratio)
-        },
-        1U
+        Vec2<size_t>{(size_t)image_width, (size_t)image_height}, 1U
     );
 
     initialize();
+    select_kernel();
+  }
+
+  // Pins render threads and picks their scene replica through `placement`.
+  void place_threads(const ThreadPlacement *placement) noexcept {
+    this->placement = placement;
+  }
+
+  // Publishes rows to `framebuffer` as they finish rendering.
+  void publish_to(LiveFramebuffer *framebuffer) noexcept {
+    live_framebuffer = framebuffer;
+  }
+
+  // Splits rows between render threads in chunks of `rows` with `schedule`.
+  void schedule_rows(size_t rows, RowSchedule schedule) {
+    if (rows == 0)
+      throw std::invalid_argument("Chunks must have at least one row.");
+    chunk_rows = rows;
+    row_schedule = schedule;
+  }
+
+  // Renders passes of one ray per pixel until `budget` has passed, instead
+  // of the fixed number of rays per pixel.
+  void render_for(std::chrono::nanoseconds budget) {
+    time_budget = budget;
+    rays_per_pixel = 1;
+    pixel_samples_scale = 1;
+    select_kernel();
+  }
+
+  // Whether `render_region` draws a progress bar.
+  void show_progress(bool show) noexcept { progress_bar = show; }
+
+  // Encodes the output image with `options`.
+  void resolve_with(const ResolveOptions &options) noexcept {
+    resolve_options = options;
+  }
+
+  [[nodiscard]] Vec2<size_t> dimensions() const noexcept { return img_dims; }
+
+  [[nodiscard]] Region full_region() const noexcept {
+    return {0, 0, img_dims[0], img_dims[1]};
+  }
+
+  // Always trace with the generic kernel, e.g. to measure what the
+  // specialized ones gain.
+  void use_generic_kernel() noexcept {
+    reordering = false;
+    row_kernel = &Camera::render_rows_generic;
+  }
+
+  // Trace the paths of a chunk's rows a bounce at a time, reordering rays
+  // between bounces, see `kernels::trace_reordered`.
+  void reorder_rays() noexcept {
+    reordering = true;
+    select_kernel();
+  }
+
+  // Whether rendering goes through a kernel specialized for this camera's
+  // sample count and bounce depth.
+  [[nodiscard]] bool specialized() const noexcept {
+    return row_kernel != &Camera::render_rows_generic &&
+           row_kernel != &Camera::render_rows_reordered;
+  }
+
+  // Traces rows `[first, last)` of `region` into `image`, whose pixels are
+  // relative to the region's upper left corner.
+  void render_rows(
+      const Hittable &world, const Region &region, size_t first, size_t last,
+      std::vector<std::vector<Color>> &image
+  ) {
+    Lights lights;
+    world.collect_lights(lights);
+    render_rows(world, lights, region, first, last, image);
+  }
+
+  // `render_rows` with the emitters of `world` already collected.
+  void render_rows(
+      const Hittable &world, const Lights &lights, const Region &region,
+      size_t first, size_t last, std::vector<std::vector<Color>> &image
+  ) {
+    (this->*row_kernel)(world, lights, region, first, last, image);
+  }
+
+  // Outputs a full frame rendered by this camera with its encoding.
+  void encode(
+      std::ostream &out, const std::vector<std::vector<Color>> &image,
+      ThreadPool *pool = nullptr
+  ) const {
+    write_image(out, image, resolve_options, pool);
   }
 
-  // Renders a `world` through this camera.
-  void render(const Hittable &world, size_t total_threads) {
-    const size_t width = img_dims[0];
-    const size_t height = img_dims[1];
-    std::vector<std::vector<Color>> image(height, std::vector<Color>(width));
+  // Renders `region` of the image with `total_threads` threads while
+  // showing a progress bar. With a time budget, passes are added until
+  // `deadline`, by default the budget from now.
+  [[nodiscard]] std::vector<std::vector<Color>> render_region(
+      const Hittable &world, size_t total_threads, const Region &region,
+      std::optional<std::chrono::steady_clock::time_point> deadline = {}
+  ) {
+    const size_t height = region.height;
+    // Rows are allocated by the render threads, see `render_thread`.
+    std::vector<std::vector<Color>> image(height);
 
     std::atomic<size_t> next_row(0);
+    rows_completed.store(0, std::memory_order_release);
+
+    // State of a time budgeted render, see `render_thread_until`.
+    const size_t chunks = (height + chunk_rows - 1) / chunk_rows;
+    std::vector<std::mutex> chunk_locks(time_budget.has_value() ? chunks : 0);
+    SampleAccumulator accumulator(time_budget.has_value() ? height : 0);
 
     std::vector<std::future<void>> futures;
     futures.reserve(total_threads);
 
     auto start_time = std::chrono::steady_clock::now();
+    if (!deadline.has_value())
+      deadline = start_time + time_budget.value_or(
+                                  std::chrono::nanoseconds::zero()
+                              );
+    std::chrono::duration<double> time_slot = *deadline - start_time;
+
+    auto run = [&](size_t thread_idx, const Hittable &thread_world) {
+      if (time_budget.has_value())
+        this->render_thread_until(
+            thread_world, region, *deadline, next_row, chunk_locks, accumulator
+        );
+      else
+        this->render_thread(
+            thread_world, region, thread_idx, total_threads, next_row, image
+        );
+    };
 
     // Spawn threads
     for (size_t thread_idx = 0; thread_idx < total_threads; ++thread_idx) {
-      futures.emplace_back(std::async(
-          std::launch::async,
-          // lambda to bind `this`.
-          [&]<typename... Args>(Args &&...args) {
-            this->render_thread(std::forward<Args>(args)...);
-          },
-          std::ref(world),
-          width,
-          height,
-          std::ref(next_row),
-          std::ref(image)
-      ));
+      futures.emplace_back(std::async(std::launch::async, [&, thread_idx] {
+        if (placement == nullptr) {
+          run(thread_idx, world);
+          return;
+        }
+        placement->pin(thread_idx);
+        run(thread_idx, placement->world_for(thread_idx, world));
+      }));
     }
 
     // Render the progress bar every 2ms in a loop until all threads finish.
+    TraceSpan progress_span("progress wait");
     // NOLINTNEXTLINE(cppcoreguidelines-avoid-do-while)
     do {
       std::this_thread::sleep_for(std::chrono::milliseconds(2));
+      if (!progress_bar)
+        continue;
+
+      std::chrono::duration<double> elapsed =
+          std::chrono::steady_clock::now() - start_time;
 
       size_t progress =
-          rows_completed.load(std::memory_order_acquire) * 100 / height;
+          time_budget.has_value()
+              ? (time_slot.count() > 0
+                     ? (size_t)std::clamp(
+                           elapsed.count() * 100 / time_slot.count(), 0.0, 100.0
+                       )
+                     : 100)
+              : rows_completed.load(std::memory_order_acquire) * 100 / height;
       size_t bar_width = 50; // Width of the progress bar in characters
       size_t pos = (progress * bar_width) / 100;
 
-      std::chrono::duration<double> elapsed =
-          std::chrono::steady_clock::now() - start_time;
-
       std::string bar =
           "[" + std::string(pos, '=') + std::string(bar_width - pos, ' ') + "]";
       std::clog << "\r" << "\x1B[2K" << bar << " " << progress << "% "
@@ -245,14 +540,86 @@ public:
           }
         })
     ));
-    std::clog << "\n";
+    if (progress_bar)
+      std::clog << "\n";
 
-    // Output the image after all threads finish
-    std::cout << "P3\n" << width << ' ' << height << "\n255\n";
-    for (const auto &row : image) {
-      for (const auto &pixel : row) {
-        write_color(std::cout, pixel);
-      }
+    // Rethrow anything a render thread failed with.
+    for (auto &future : futures)
+      future.get();
+
+    if (time_budget.has_value()) {
+      std::chrono::duration<double> elapsed =
+          std::chrono::steady_clock::now() - start_time;
+      auto [fewest, most] = accumulator.sample_range();
+      std::clog << fmt::format(
+          "Traced {} to {} rays per pixel in {:.3f} seconds.\n",
+          fewest,
+          most,
+          elapsed.count()
+      );
+      return std::move(accumulator).resolve();
+    }
+    return image;
+  }
+
+  // Renders a `world` through this camera. Given `crops`, only those windows
+  // of the frame are rendered, each output as a partial image.
+  void render(
+      const Hittable &world, size_t total_threads,
+      std::span<const Region> crops = {}
+  ) {
+    // Check every crop before rendering any, so a bad one cannot cut the
+    // output short after earlier ones were written.
+    for (const auto &crop : crops)
+      if (!crop.fits_within(img_dims[0], img_dims[1]))
+        throw std::out_of_range(fmt::format(
+            "Crop {}x{}+{}+{} does not fit in the {}x{} image.",
+            crop.width,
+            crop.height,
+            crop.x,
+            crop.y,
+            img_dims[0],
+            img_dims[1]
+        ));
+
+    // Resolves the finished image on the render threads' cores.
+    ThreadPool pool(total_threads);
+
+    if (crops.empty()) {
+      auto image = render_region(world, total_threads, full_region());
+      // Output the image after all threads finish
+      TraceSpan span("encode");
+      write_image(std::cout, image, resolve_options, &pool);
+    }
+
+    // A time budget covers all crops together, split by their areas. Each
+    // crop ends where its share of the budget does, counted from the start,
+    // so overrunning one shortens the next instead of the whole job.
+    auto start_time = std::chrono::steady_clock::now();
+    size_t total_area = 0;
+    for (const auto &crop : crops)
+      total_area += crop.width * crop.height;
+    size_t area_done = 0;
+
+    for (const auto &crop : crops) {
+      area_done += crop.width * crop.height;
+      std::optional<std::chrono::steady_clock::time_point> deadline;
+      if (time_budget.has_value())
+        deadline = start_time +
+                   std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       *time_budget * ((double)area_done / (double)total_area)
+                   );
+      auto image = render_region(world, total_threads, crop, deadline);
+      TraceSpan span("encode");
+      write_partial_image(
+          std::cout,
+          image,
+          crop,
+          img_dims[0],
+          img_dims[1],
+          resolve_options,
+          &pool
+      );
     }
 
     std::clog << "Done.\n";
@@ -0,0 +1,78 @@
+#ifndef DISK_H
+#define DISK_H
+
+#include <algorithm>
+#include <cmath>
+#include <optional>
+#include <utility>
+
+#include "aabb.h"
+#include "hittable.h"
+#include "interval.h"
+#include "material.h"
+#include "plane.h"
+#include "ray.h"
+#include "vec.h"
+
+// A flat disk, the part of a plane within `radius` of `center`.
+class Disk : public Hittable {
+  Point3 disk_center;
+  Vec3 disk_normal; // Unit length, pointing to the front side.
+  double disk_radius;
+  Material disk_material;
+
+public:
+  Disk(
+      Point3 center, const Vec3 &normal, double radius, Material material = {}
+  )
+      : disk_center(std::move(center)), disk_normal(blaze::normalize(normal)),
+        disk_radius(std::max(0.0, radius)),
+        disk_material(std::move(material)) {}
+
+  [[nodiscard]] const Point3 &center() const noexcept { return disk_center; }
+  [[nodiscard]] const Vec3 &normal() const noexcept { return disk_normal; }
+  [[nodiscard]] double radius() const noexcept { return disk_radius; }
+  [[nodiscard]] const Material &material() const noexcept {
+    return disk_material;
+  }
+
+  [[gnu::hot]] [[nodiscard]]
+  static std::optional<HitRecord> intersect(
+      const Point3 &center, const Vec3 &normal, double radius, const Ray &ray,
+      Interval<double> ray_t
+  ) {
+    auto time = Plane::distance(center, normal, ray, ray_t);
+    if (!time.has_value() ||
+        blaze::sqrNorm(Vec3(ray.at(*time) - center)) > radius * radius)
+      return {};
+    return HitRecord::from_face_normal(ray, *time, normal);
+  }
+
+  // Box of a disk, which extends `radius * sin` of the angle between its
+  // normal and each axis along that axis.
+  [[nodiscard]] static AABB
+  bounds(const Point3 &center, const Vec3 &normal, double radius) {
+    Vec3 extent;
+    for (size_t axis = 0; axis < 3; ++axis)
+      extent[axis] =
+          radius * std::sqrt(std::max(0.0, 1 - normal[axis] * normal[axis]));
+    return AABB::from_points(
+        Point3(center - extent), Point3(center + extent)
+    );
+  }
+
+  [[nodiscard]] std::optional<HitRecord>
+  hit(const Ray &ray, Interval<double> ray_t) const override {
+    auto record =
+        intersect(disk_center, disk_normal, disk_radius, ray, ray_t);
+    if (record.has_value())
+      record->material = &disk_material;
+    return record;
+  }
+
+  [[nodiscard]] std::optional<AABB> bounding_box() const override {
+    return bounds(disk_center, disk_normal, disk_radius);
+  }
+};
+
+#endif
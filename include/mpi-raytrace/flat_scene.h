@@ -0,0 +1,522 @@
+#ifndef FLAT_SCENE_H
+#define FLAT_SCENE_H
+
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <typeinfo>
+#include <utility>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include "aabb.h"
+#include "box.h"
+#include "compact_bvh.h"
+#include "disk.h"
+#include "hittable.h"
+#include "hittable_list.h"
+#include "interval.h"
+#include "lights.h"
+#include "material.h"
+#include "plane.h"
+#include "ray.h"
+#include "sphere.h"
+#include "triangle_mesh.h"
+#include "vec.h"
+
+// A scene and its acceleration structure packed into one contiguous buffer.
+//
+// The buffer holds no pointers, only byte offsets from its start, so it can
+// be copied between processes, broadcast over MPI or mapped at any address
+// and traced in place through a `FlatSceneView`. Every bounded primitive
+// sits in a single `CompactBVH` whose leaves reference runs of the primitive
+// table; planes are unbounded and tested on every ray instead.
+struct FlatSceneHeader {
+  static constexpr uint32_t MAGIC = 0x4e435346; // "FSCN"
+  static constexpr uint32_t VERSION = 3;
+
+  uint32_t magic;
+  uint32_t version;
+  uint64_t material_count, sphere_count, plane_count, disk_count, box_count;
+  uint64_t vertex_count, triangle_count, node_count, primitive_count;
+  // Byte offsets of the arrays below, each 64 byte aligned.
+  uint64_t materials_offset;  // `FlatMaterial[material_count]`
+  uint64_t spheres_offset;    // `FlatSphere[sphere_count]`
+  uint64_t planes_offset;     // `FlatPlane[plane_count]`
+  uint64_t disks_offset;      // `FlatDisk[disk_count]`
+  uint64_t boxes_offset;      // `FlatBox[box_count]`
+  uint64_t vertices_offset;   // `TriangleMesh::Vertex[vertex_count]`
+  uint64_t triangles_offset;  // `TriangleMesh::Triangle[triangle_count]`
+  uint64_t nodes_offset;      // `CompactBVH<>::Node[node_count]`
+  uint64_t primitives_offset; // `uint32_t[primitive_count]`, leaf order.
+  uint64_t size;              // Total size of the buffer in bytes.
+  AABB bounds;                // Of the bounded primitives.
+};
+
+struct FlatMaterial {
+  std::array<double, 3> albedo, emission;
+};
+
+// Primitives refer to their entry in the material table. Triangles use the
+// default material.
+struct FlatSphere {
+  std::array<double, 3> center;
+  double radius;
+  uint32_t material;
+};
+
+struct FlatPlane {
+  std::array<double, 3> point, normal;
+  uint32_t material;
+};
+
+struct FlatDisk {
+  std::array<double, 3> center, normal;
+  double radius;
+  uint32_t material;
+};
+
+struct FlatBox {
+  std::array<double, 3> lo, hi;
+  uint32_t material;
+};
+
+// Storage for a flat scene, aligned for its BVH nodes.
+struct alignas(64) FlatSceneBlock {
+  std::array<std::byte, 64> bytes;
+};
+using FlatSceneBuffer = std::vector<FlatSceneBlock>;
+
+namespace detail {
+
+// Primitive table entries hold the kind of primitive in their top two bits
+// and its index among primitives of that kind in the rest.
+enum class FlatKind : uint32_t { triangle, sphere, disk, box };
+constexpr uint32_t KIND_SHIFT = 30;
+constexpr uint32_t INDEX_MASK = (uint32_t{1} << KIND_SHIFT) - 1;
+
+constexpr uint32_t flat_primitive(FlatKind kind, size_t index) {
+  return (uint32_t)kind << KIND_SHIFT | (uint32_t)index;
+}
+
+constexpr size_t align_block(size_t offset) {
+  return (offset + sizeof(FlatSceneBlock) - 1) / sizeof(FlatSceneBlock) *
+         sizeof(FlatSceneBlock);
+}
+
+inline std::array<double, 3> flat(const Vec3 &v) {
+  return {v[0], v[1], v[2]};
+}
+
+inline Point3 point(const std::array<double, 3> &v) {
+  return Point3{v[0], v[1], v[2]};
+}
+
+// Primitives of a scene, gathered for flattening.
+struct FlatSceneParts {
+  std::vector<FlatMaterial> materials;
+  std::vector<FlatSphere> spheres;
+  std::vector<FlatPlane> planes;
+  std::vector<FlatDisk> disks;
+  std::vector<FlatBox> boxes;
+  std::vector<TriangleMesh::Vertex> vertices;
+  std::vector<TriangleMesh::Triangle> triangles;
+
+  uint32_t add(const Material &material) {
+    materials.push_back({flat(material.albedo), flat(material.emission)});
+    return (uint32_t)(materials.size() - 1);
+  }
+
+  // Collects the primitives of `object`, descending into lists.
+  void gather(const Hittable &object) {
+    if (const auto *list = dynamic_cast<const HittableList *>(&object)) {
+      for (const auto &child : list->objects)
+        gather(*child);
+    } else if (const auto *sphere = dynamic_cast<const Sphere *>(&object)) {
+      spheres.push_back(
+          {flat(sphere->center()), sphere->radius(), add(sphere->material())}
+      );
+    } else if (const auto *plane = dynamic_cast<const Plane *>(&object)) {
+      planes.push_back(
+          {flat(plane->point()), flat(plane->normal()), add(plane->material())}
+      );
+    } else if (const auto *disk = dynamic_cast<const Disk *>(&object)) {
+      disks.push_back(
+          {flat(disk->center()),
+           flat(disk->normal()),
+           disk->radius(),
+           add(disk->material())}
+      );
+    } else if (const auto *box = dynamic_cast<const Box *>(&object)) {
+      boxes.push_back({flat(box->lo()), flat(box->hi()), add(box->material())}
+      );
+    } else if (const auto *mesh = dynamic_cast<const TriangleMesh *>(&object)) {
+      auto base = vertices.size();
+      if (base + mesh->vertex_count() > std::numeric_limits<uint32_t>::max())
+        throw std::length_error("A flat scene is limited to 2^32 vertices.");
+      vertices.insert(
+          vertices.end(),
+          mesh->vertex_data().begin(),
+          mesh->vertex_data().end()
+      );
+      for (auto tri : mesh->triangle_data()) {
+        for (auto &index : tri)
+          index += (uint32_t)base;
+        triangles.push_back(tri);
+      }
+    } else {
+      throw std::invalid_argument(fmt::format(
+          "Cannot flatten a scene containing {}.", typeid(object).name()
+      ));
+    }
+  }
+};
+
+} // namespace detail
+
+// Packs the primitives and triangle meshes of `scene` into a flat scene.
+[[nodiscard]] inline FlatSceneBuffer flatten_scene(const Hittable &scene) {
+  using detail::FlatKind;
+
+  detail::FlatSceneParts parts;
+  parts.gather(scene);
+  const auto &[materials, spheres, planes, disks, boxes, vertices, triangles] =
+      parts;
+
+  // Bounds of the bounded primitives, with their primitive table entries.
+  std::vector<AABB> bounds;
+  std::vector<uint32_t> entries;
+  auto add_bounds = [&](FlatKind kind, size_t count, auto box_of) {
+    if (count > detail::INDEX_MASK)
+      throw std::length_error(
+          "A flat scene is limited to 2^30 primitives of a kind."
+      );
+    for (size_t i = 0; i < count; ++i) {
+      bounds.push_back(box_of(i));
+      entries.push_back(detail::flat_primitive(kind, i));
+    }
+  };
+  add_bounds(FlatKind::sphere, spheres.size(), [&](size_t i) {
+    return *Sphere(detail::point(spheres[i].center), spheres[i].radius)
+                .bounding_box();
+  });
+  add_bounds(FlatKind::disk, disks.size(), [&](size_t i) {
+    return Disk::bounds(
+        detail::point(disks[i].center),
+        Vec3(detail::point(disks[i].normal)),
+        disks[i].radius
+    );
+  });
+  add_bounds(FlatKind::box, boxes.size(), [&](size_t i) {
+    return AABB::from_points(
+        detail::point(boxes[i].lo), detail::point(boxes[i].hi)
+    );
+  });
+  add_bounds(FlatKind::triangle, triangles.size(), [&](size_t i) {
+    AABB box;
+    for (auto index : triangles[i])
+      box.expand(vertices[index]);
+    return box;
+  });
+
+  std::vector<uint32_t> order;
+  CompactBVH<> tree(bounds, order);
+  for (auto &index : order)
+    index = entries[index];
+
+  FlatSceneHeader header{};
+  header.magic = FlatSceneHeader::MAGIC;
+  header.version = FlatSceneHeader::VERSION;
+  header.material_count = materials.size();
+  header.sphere_count = spheres.size();
+  header.plane_count = planes.size();
+  header.disk_count = disks.size();
+  header.box_count = boxes.size();
+  header.vertex_count = vertices.size();
+  header.triangle_count = triangles.size();
+  header.node_count = tree.node_count();
+  header.primitive_count = order.size();
+  header.bounds = tree.bounds();
+
+  size_t offset = detail::align_block(sizeof(FlatSceneHeader));
+  auto place = [&](size_t bytes) {
+    auto start = offset;
+    offset = detail::align_block(offset + bytes);
+    return start;
+  };
+  header.materials_offset = place(std::span(materials).size_bytes());
+  header.spheres_offset = place(std::span(spheres).size_bytes());
+  header.planes_offset = place(std::span(planes).size_bytes());
+  header.disks_offset = place(std::span(disks).size_bytes());
+  header.boxes_offset = place(std::span(boxes).size_bytes());
+  header.vertices_offset = place(std::span(vertices).size_bytes());
+  header.triangles_offset = place(std::span(triangles).size_bytes());
+  header.nodes_offset = place(tree.node_data().size_bytes());
+  header.primitives_offset = place(std::span(order).size_bytes());
+  header.size = offset;
+
+  FlatSceneBuffer buffer(offset / sizeof(FlatSceneBlock));
+  auto *base = std::as_writable_bytes(std::span(buffer)).data();
+  auto copy = [&](size_t at, auto data) {
+    if (!data.empty())
+      std::memcpy(base + at, data.data(), data.size_bytes());
+  };
+  copy(0, std::span(&header, 1));
+  copy(header.materials_offset, std::span(materials));
+  copy(header.spheres_offset, std::span(spheres));
+  copy(header.planes_offset, std::span(planes));
+  copy(header.disks_offset, std::span(disks));
+  copy(header.boxes_offset, std::span(boxes));
+  copy(header.vertices_offset, std::span(vertices));
+  copy(header.triangles_offset, std::span(triangles));
+  copy(header.nodes_offset, tree.node_data());
+  copy(header.primitives_offset, std::span(order));
+  return buffer;
+}
+
+// Traces against a flat scene in place. The view does not own the buffer,
+// which has to outlive it.
+class FlatSceneView : public Hittable {
+  using Node = CompactBVH<>::Node;
+
+  FlatSceneHeader header{};
+  std::span<const FlatSphere> spheres;
+  std::span<const FlatPlane> planes;
+  std::span<const FlatDisk> disks;
+  std::span<const FlatBox> boxes;
+  std::span<const TriangleMesh::Vertex> vertices;
+  std::span<const TriangleMesh::Triangle> triangles;
+  std::span<const Node> nodes;
+  std::span<const uint32_t> primitives;
+  std::vector<Material> materials; // Rebuilt per view.
+
+  [[nodiscard]] Point3 vertex(uint32_t index) const {
+    const auto &v = vertices[index];
+    return Point3{(double)v[0], (double)v[1], (double)v[2]};
+  }
+
+  template <typename T>
+  [[nodiscard]] std::span<const T> array(
+      std::span<const std::byte> buffer, uint64_t offset, uint64_t count
+  ) const {
+    if (offset % alignof(T) != 0 || offset > header.size ||
+        count > (header.size - offset) / sizeof(T))
+      throw std::invalid_argument("Flat scene array is out of bounds.");
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    return {reinterpret_cast<const T *>(buffer.data() + offset), count};
+  }
+
+  // Checks that every primitive of `table` refers to an existing material.
+  template <typename T> void check_materials(std::span<const T> table) const {
+    for (const auto &primitive : table)
+      if (primitive.material >= materials.size())
+        throw std::invalid_argument("Flat scene material is out of bounds.");
+  }
+
+  // Checks that the primitive table, the BVH over it and the triangles only
+  // refer to primitives and vertices that exist, so tracing never reads past
+  // the buffer.
+  void check_indices() const {
+    using detail::FlatKind;
+    CompactBVH<>::validate(nodes, primitives.size());
+    for (auto primitive : primitives) {
+      auto index = primitive & detail::INDEX_MASK;
+      size_t count = 0;
+      switch ((FlatKind)(primitive >> detail::KIND_SHIFT)) {
+      case FlatKind::triangle:
+        count = triangles.size();
+        break;
+      case FlatKind::sphere:
+        count = spheres.size();
+        break;
+      case FlatKind::disk:
+        count = disks.size();
+        break;
+      case FlatKind::box:
+        count = boxes.size();
+        break;
+      }
+      if (index >= count)
+        throw std::invalid_argument("Flat scene primitive is out of bounds.");
+    }
+    for (const auto &triangle : triangles)
+      for (auto vertex : triangle)
+        if (vertex >= vertices.size())
+          throw std::invalid_argument("Flat scene vertex is out of bounds.");
+  }
+
+  // Sets the material of a hit on a primitive with material `index`.
+  [[nodiscard]] std::optional<HitRecord>
+  with_material(std::optional<HitRecord> record, uint32_t index) const {
+    if (record.has_value())
+      record->material = &materials[index];
+    return record;
+  }
+
+  [[gnu::hot]] [[nodiscard]] std::optional<HitRecord>
+  hit_primitive(uint32_t primitive, const Ray &ray, Interval<double> ray_t)
+      const {
+    using detail::FlatKind, detail::point;
+    auto index = primitive & detail::INDEX_MASK;
+    switch ((FlatKind)(primitive >> detail::KIND_SHIFT)) {
+    case FlatKind::triangle: {
+      const auto &tri = triangles[index];
+      return TriangleMesh::intersect(
+          vertex(tri[0]), vertex(tri[1]), vertex(tri[2]), ray, ray_t
+      );
+    }
+    case FlatKind::sphere: {
+      const auto &sphere = spheres[index];
+      return with_material(
+          Sphere::intersect(point(sphere.center), sphere.radius, ray, ray_t),
+          sphere.material
+      );
+    }
+    case FlatKind::disk: {
+      const auto &disk = disks[index];
+      return with_material(
+          Disk::intersect(
+              point(disk.center),
+              Vec3(point(disk.normal)),
+              disk.radius,
+              ray,
+              ray_t
+          ),
+          disk.material
+      );
+    }
+    case FlatKind::box: {
+      const auto &box = boxes[index];
+      return with_material(
+          Box::intersect(point(box.lo), point(box.hi), ray, ray_t),
+          box.material
+      );
+    }
+    }
+    return {};
+  }
+
+public:
+  explicit FlatSceneView(std::span<const std::byte> buffer) {
+    if (buffer.size() < sizeof(FlatSceneHeader))
+      throw std::invalid_argument("Flat scene buffer is truncated.");
+    std::memcpy(&header, buffer.data(), sizeof(header));
+    if (header.magic != FlatSceneHeader::MAGIC ||
+        header.version != FlatSceneHeader::VERSION)
+      throw std::invalid_argument("Not a flat scene buffer.");
+    if (header.size > buffer.size())
+      throw std::invalid_argument("Flat scene buffer is truncated.");
+    if (std::bit_cast<uintptr_t>(buffer.data()) % alignof(Node) != 0)
+      throw std::invalid_argument(
+          fmt::format("Flat scenes must be {} byte aligned.", alignof(Node))
+      );
+
+    auto flat_materials = array<FlatMaterial>(
+        buffer, header.materials_offset, header.material_count
+    );
+    spheres = array<FlatSphere>(
+        buffer, header.spheres_offset, header.sphere_count
+    );
+    planes = array<FlatPlane>(buffer, header.planes_offset, header.plane_count);
+    disks = array<FlatDisk>(buffer, header.disks_offset, header.disk_count);
+    boxes = array<FlatBox>(buffer, header.boxes_offset, header.box_count);
+    vertices = array<TriangleMesh::Vertex>(
+        buffer, header.vertices_offset, header.vertex_count
+    );
+    triangles = array<TriangleMesh::Triangle>(
+        buffer, header.triangles_offset, header.triangle_count
+    );
+    nodes = array<Node>(buffer, header.nodes_offset, header.node_count);
+    primitives = array<uint32_t>(
+        buffer, header.primitives_offset, header.primitive_count
+    );
+
+    materials.reserve(flat_materials.size());
+    for (const auto &material : flat_materials)
+      materials.push_back(
+          {Color{material.albedo[0], material.albedo[1], material.albedo[2]},
+           Color{
+               material.emission[0],
+               material.emission[1],
+               material.emission[2]
+           }}
+      );
+    check_materials(spheres);
+    check_materials(planes);
+    check_materials(disks);
+    check_materials(boxes);
+    check_indices();
+  }
+
+  [[nodiscard]] size_t size_bytes() const noexcept { return header.size; }
+  [[nodiscard]] size_t primitive_count() const noexcept {
+    return primitives.size() + planes.size();
+  }
+
+  [[gnu::hot]] [[nodiscard]]
+  std::optional<HitRecord>
+  hit(const Ray &ray, Interval<double> ray_t) const override {
+    std::optional<HitRecord> result;
+    auto closest_so_far = ray_t.end();
+
+    for (const auto &plane : planes) {
+      auto record = with_material(
+          Plane::intersect(
+              detail::point(plane.point),
+              Vec3(detail::point(plane.normal)),
+              ray,
+              Interval(ray_t.begin(), closest_so_far)
+          ),
+          plane.material
+      );
+      if (record.has_value()) {
+        closest_so_far = record->time;
+        result = std::move(*record);
+      }
+    }
+
+    CompactBVH<>::traverse(
+        nodes,
+        ray,
+        Interval(ray_t.begin(), closest_so_far),
+        [&](uint32_t first, uint32_t count, double &closest) {
+          for (auto i = first; i < first + count; ++i) {
+            auto record = hit_primitive(
+                primitives[i], ray, Interval(ray_t.begin(), closest)
+            );
+            if (record.has_value()) {
+              closest = record->time;
+              result = std::move(*record);
+            }
+          }
+        }
+    );
+
+    return result;
+  }
+
+  void collect_lights(Lights &lights) const override {
+    for (const auto &sphere : spheres)
+      if (materials[sphere.material].emissive())
+        lights.add(
+            {detail::point(sphere.center),
+             sphere.radius,
+             &materials[sphere.material]}
+        );
+  }
+
+  [[nodiscard]] std::optional<AABB> bounding_box() const override {
+    if (!planes.empty())
+      return {};
+    return header.bounds;
+  }
+};
+
+#endif
@@ -1,8 +1,11 @@
 #ifndef HITTABLE_H
 #define HITTABLE_H
 
+#include "aabb.h"
 #include "blaze/math/Vector.h"
 #include "interval.h"
+#include "lights.h"
+#include "material.h"
 #include "ray.h"
 #include "vec.h"
 #include <cmath>
@@ -16,6 +19,7 @@ struct HitRecord {
   double time{};
   // is the hit on the front or back of the surface?
   bool is_frontface{};
+  const Material *material = &DEFAULT_MATERIAL;
 
   // Creates a `HitRecord` based on the vector point away from the surface's
   // outer side, aka the `outward_normal`.
@@ -50,6 +54,16 @@ public:
   [[nodiscard]]
   virtual std::optional<HitRecord>
   hit(const Ray &ray, Interval<double> ray_t) const = 0;
+
+  // Box enclosing the object, or nothing for unbounded objects which
+  // acceleration structures have to test separately.
+  [[nodiscard]]
+  virtual std::optional<AABB> bounding_box() const {
+    return {};
+  }
+
+  // Adds the emissive primitives among this object to `lights`.
+  virtual void collect_lights(Lights & /*lights*/) const {}
 };
 
 #endif
\ No newline at end of file
@@ -1,6 +1,7 @@
 #ifndef HITTABLE_LIST_H
 #define HITTABLE_LIST_H
 
+#include "aabb.h"
 #include "hittable.h"
 #include "interval.h"
 #include "ray.h"
@@ -44,6 +45,23 @@ public:
 
     return result;
   }
+
+  void collect_lights(Lights &lights) const override {
+    for (const auto &object : objects)
+      object->collect_lights(lights);
+  }
+
+  // Union of every object's box, or nothing if any object is unbounded.
+  [[nodiscard]] std::optional<AABB> bounding_box() const override {
+    AABB box;
+    for (const auto &object : objects) {
+      auto object_box = object->bounding_box();
+      if (!object_box.has_value())
+        return {};
+      box.expand(*object_box);
+    }
+    return box;
+  }
 };
 
 #endif
\ No newline at end of file
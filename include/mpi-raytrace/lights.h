@@ -0,0 +1,95 @@
+#ifndef LIGHTS_H
+#define LIGHTS_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <numbers>
+#include <optional>
+#include <vector>
+
+#include "material.h"
+#include "sampling.h"
+#include "vec.h"
+
+// An emissive sphere, referring to the material of the primitive it was
+// collected from so hits on it can be recognized.
+struct SphereLight {
+  Point3 center;
+  double radius;
+  const Material *material;
+};
+
+struct LightSample {
+  Vec3 direction;
+  double pdf;      // Includes the probability of picking the light.
+  double distance; // Upper bound on the distance to the light.
+  const Material *material;
+};
+
+// The emissive primitives of a scene, for sampling direct light.
+class Lights {
+  std::vector<SphereLight> spheres;
+
+  // Cosine of the half angle the light subtends from `origin`, if `origin`
+  // lies outside of it.
+  [[nodiscard]] static std::optional<double>
+  cone(const SphereLight &light, const Point3 &origin, double &distance) {
+    distance = blaze::norm(Vec3(light.center - origin));
+    if (distance <= light.radius)
+      return {};
+    auto sin_max = light.radius / distance;
+    auto cos_max = std::sqrt(std::max(0.0, 1 - sin_max * sin_max));
+    if (cos_max >= 1) // Too small to sample from here.
+      return {};
+    return cos_max;
+  }
+
+public:
+  void add(const SphereLight &light) { spheres.push_back(light); }
+  [[nodiscard]] bool empty() const noexcept { return spheres.empty(); }
+  [[nodiscard]] size_t size() const noexcept { return spheres.size(); }
+
+  // Picks a light uniformly and samples a direction from `origin` towards
+  // it, uniformly over the solid angle it covers.
+  [[nodiscard]] std::optional<LightSample> sample(const Point3 &origin) const {
+    if (spheres.empty())
+      return {};
+    auto pick = std::min(
+        (size_t)(path_random<1>()[0] * (double)spheres.size()),
+        spheres.size() - 1
+    );
+    const auto &light = spheres[pick];
+    double distance{};
+    auto cos_max = cone(light, origin, distance);
+    if (!cos_max.has_value())
+      return {};
+    auto axis = Vec3((light.center - origin) / distance);
+    auto [direction, pdf] = sample_cone(axis, *cos_max);
+    return LightSample{
+        direction,
+        pdf / (double)spheres.size(),
+        distance + light.radius,
+        light.material
+    };
+  }
+
+  // Density with which `sample` picks a direction from `origin` that hits
+  // the light with `material`.
+  [[nodiscard]] double
+  pdf(const Point3 &origin, const Material *material) const {
+    for (const auto &light : spheres) {
+      if (light.material != material)
+        continue;
+      double distance{};
+      auto cos_max = cone(light, origin, distance);
+      if (!cos_max.has_value())
+        return 0;
+      return 1 / (2 * std::numbers::pi * (1 - *cos_max)) /
+             (double)spheres.size();
+    }
+    return 0;
+  }
+};
+
+#endif
@@ -0,0 +1,191 @@
+#ifndef LIVE_FRAMEBUFFER_H
+#define LIVE_FRAMEBUFFER_H
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <climits>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <span>
+#include <string>
+#include <system_error>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "color.h"
+
+// Layout of the shared-memory segment published by `LiveFramebuffer`. Other
+// processes map the segment read-only and use the offsets below; everything
+// is native endian.
+struct LiveFramebufferHeader {
+  static constexpr uint32_t MAGIC = 0x42465452; // "RTFB"
+  static constexpr uint32_t VERSION = 1;
+
+  uint32_t magic;
+  uint32_t version;
+  uint32_t width, height;           // Full image size in pixels.
+  uint32_t tile_width, tile_height; // Tiles that sample counts cover.
+  uint32_t tiles_x, tiles_y;
+  uint64_t samples_offset; // Byte offset of `uint32_t[tiles_y][tiles_x]`.
+  uint64_t pixels_offset;  // Byte offset of `float[height][width][3]`.
+  // Incremented after every published row. Readers poll it to notice
+  // updates. A tile's sample count is raised only after all of its pixels
+  // hold that many samples.
+  std::atomic<uint64_t> generation;
+  std::atomic<uint32_t> complete; // Set once the render has finished.
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free);
+static_assert(std::atomic<uint32_t>::is_always_lock_free);
+
+// Publishes the linear framebuffer of an in-progress render into a POSIX
+// shared-memory segment. Render threads write their own pixels and only touch
+// atomics to publish them, so they never wait on readers or on each other.
+class LiveFramebuffer {
+  static constexpr size_t ALIGNMENT = 64;
+
+  std::string name;
+  std::byte *base = nullptr;
+  size_t size = 0;
+  LiveFramebufferHeader *header = nullptr;
+  std::atomic<uint32_t> *samples = nullptr;
+  float *pixels = nullptr;
+  // Samples in every published pixel. A tile's count is the least of its
+  // pixels', so rows of a later pass cannot complete a tile for an earlier
+  // one.
+  std::unique_ptr<std::atomic<uint32_t>[]> pixel_samples;
+
+  // Fewest samples in any pixel of a tile.
+  [[nodiscard]] uint32_t tile_samples(size_t tile_x, size_t tile_y) const {
+    auto x_end = std::min<size_t>(
+        (tile_x + 1) * header->tile_width, header->width
+    );
+    auto y_end = std::min<size_t>(
+        (tile_y + 1) * header->tile_height, header->height
+    );
+    auto fewest = UINT32_MAX;
+    for (auto y = tile_y * header->tile_height; y < y_end; ++y)
+      for (auto x = tile_x * header->tile_width; x < x_end; ++x)
+        fewest = std::min(
+            fewest,
+            pixel_samples[y * header->width + x].load(std::memory_order_acquire)
+        );
+    return fewest;
+  }
+
+  static size_t align(size_t offset) {
+    return (offset + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+  }
+
+public:
+  // Creates (or replaces) the segment `name`, e.g. "/mpi-raytrace".
+  LiveFramebuffer(
+      std::string name, size_t width, size_t height, size_t tile_width,
+      size_t tile_height
+  )
+      : name(std::move(name)) {
+    auto tiles_x = (width + tile_width - 1) / tile_width;
+    auto tiles_y = (height + tile_height - 1) / tile_height;
+    auto samples_offset = align(sizeof(LiveFramebufferHeader));
+    auto pixels_offset =
+        align(samples_offset + tiles_x * tiles_y * sizeof(uint32_t));
+    size = pixels_offset + width * height * 3 * sizeof(float);
+
+    int fd = ::shm_open(this->name.c_str(), O_CREAT | O_RDWR, 0644);
+    if (fd < 0)
+      throw std::system_error(errno, std::generic_category(), this->name);
+    if (::ftruncate(fd, (off_t)size) != 0) {
+      auto err = errno;
+      ::close(fd);
+      throw std::system_error(err, std::generic_category(), this->name);
+    }
+    void *mapping =
+        ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED)
+      throw std::system_error(errno, std::generic_category(), this->name);
+    base = static_cast<std::byte *>(mapping);
+
+    header = new (base) LiveFramebufferHeader{
+        LiveFramebufferHeader::MAGIC,
+        LiveFramebufferHeader::VERSION,
+        (uint32_t)width,
+        (uint32_t)height,
+        (uint32_t)tile_width,
+        (uint32_t)tile_height,
+        (uint32_t)tiles_x,
+        (uint32_t)tiles_y,
+        samples_offset,
+        pixels_offset,
+        {0},
+        {0}
+    };
+    // NOLINTBEGIN(cppcoreguidelines-pro-type-reinterpret-cast)
+    samples =
+        reinterpret_cast<std::atomic<uint32_t> *>(base + samples_offset);
+    std::uninitialized_value_construct_n(samples, tiles_x * tiles_y);
+    pixels = reinterpret_cast<float *>(base + pixels_offset);
+    std::uninitialized_value_construct_n(pixels, width * height * 3);
+    // NOLINTEND(cppcoreguidelines-pro-type-reinterpret-cast)
+
+    pixel_samples = std::make_unique<std::atomic<uint32_t>[]>(width * height);
+  }
+
+  // Marks the render complete and removes the name. Readers that already
+  // mapped the segment keep their view of the final image.
+  ~LiveFramebuffer() {
+    header->complete.store(1, std::memory_order_release);
+    ::munmap(base, size);
+    ::shm_unlink(name.c_str());
+  }
+
+  LiveFramebuffer(const LiveFramebuffer &) = delete;
+  LiveFramebuffer(LiveFramebuffer &&) = delete;
+  LiveFramebuffer &operator=(const LiveFramebuffer &) = delete;
+  LiveFramebuffer &operator=(LiveFramebuffer &&) = delete;
+
+  // Publishes `row`, the pixels of image row `y` starting at column `x`,
+  // rendered with `sample_count` samples per pixel.
+  void publish_row(
+      size_t x, size_t y, std::span<const Color> row, uint32_t sample_count
+  ) {
+    if (row.empty())
+      return;
+    auto *out = pixels + (y * header->width + x) * 3;
+    for (const auto &pixel : row) {
+      *out++ = (float)pixel[0];
+      *out++ = (float)pixel[1];
+      *out++ = (float)pixel[2];
+    }
+
+    auto *counts = &pixel_samples[y * header->width + x];
+    for (size_t col = 0; col < row.size(); ++col)
+      counts[col].store(sample_count, std::memory_order_release);
+
+    // Raise the sample count of every tile this row touches to the fewest
+    // samples of its pixels. Counts only grow, even when threads race.
+    auto tile_y = y / header->tile_height;
+    auto last_tile_x = (x + row.size() - 1) / header->tile_width;
+    auto first_tile_x = x / header->tile_width;
+    for (auto tile_x = first_tile_x; tile_x <= last_tile_x; ++tile_x) {
+      auto tile = tile_y * header->tiles_x + tile_x;
+      auto fewest = tile_samples(tile_x, tile_y);
+      auto current = samples[tile].load(std::memory_order_relaxed);
+      while (current < fewest &&
+             !samples[tile].compare_exchange_weak(
+                 current, fewest, std::memory_order_release
+             )) {
+      }
+    }
+
+    header->generation.fetch_add(1, std::memory_order_release);
+  }
+};
+
+#endif
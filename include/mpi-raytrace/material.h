@@ -0,0 +1,20 @@
+#ifndef MATERIAL_H
+#define MATERIAL_H
+
+#include "color.h"
+
+// Surface properties of a primitive. Surfaces are Lambertian: they scatter
+// `albedo` of the incoming light and emit `emission` from their front face.
+struct Material {
+  Color albedo{0.7, 0.7, 0.7};
+  Color emission{0, 0, 0};
+
+  [[nodiscard]] bool emissive() const {
+    return emission[0] > 0 || emission[1] > 0 || emission[2] > 0;
+  }
+};
+
+// Material of primitives that are not given one.
+inline const Material DEFAULT_MATERIAL{};
+
+#endif
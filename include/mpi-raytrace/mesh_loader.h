@@ -0,0 +1,196 @@
+#ifndef MESH_LOADER_H
+#define MESH_LOADER_H
+
+#include <cerrno>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fmt/format.h>
+
+#include "triangle_mesh.h"
+
+// Read-only memory mapping of a whole file.
+class MappedFile {
+  const char *data_ = nullptr;
+  size_t size_ = 0;
+
+public:
+  explicit MappedFile(const std::string &path) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+      throw std::system_error(errno, std::generic_category(), path);
+
+    struct stat info {};
+    if (::fstat(fd, &info) != 0) {
+      auto err = errno;
+      ::close(fd);
+      throw std::system_error(err, std::generic_category(), path);
+    }
+    size_ = (size_t)info.st_size;
+
+    if (size_ > 0) {
+      void *mapping = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (mapping == MAP_FAILED) {
+        auto err = errno;
+        ::close(fd);
+        throw std::system_error(err, std::generic_category(), path);
+      }
+      // The file is parsed front to back exactly once.
+      ::madvise(mapping, size_, MADV_SEQUENTIAL);
+      data_ = static_cast<const char *>(mapping);
+    }
+    ::close(fd);
+  }
+
+  ~MappedFile() {
+    if (data_ != nullptr)
+      // NOLINTNEXTLINE(cppcoreguidelines-pro-type-const-cast)
+      ::munmap(const_cast<char *>(data_), size_);
+  }
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+  MappedFile(MappedFile &&other) noexcept
+      : data_(std::exchange(other.data_, nullptr)),
+        size_(std::exchange(other.size_, 0)) {}
+  MappedFile &operator=(MappedFile &&) = delete;
+
+  [[nodiscard]] std::string_view view() const noexcept {
+    return {data_, size_};
+  }
+};
+
+namespace detail {
+
+// Splits a mapped buffer into lines without copying.
+template <typename F> void for_each_line(std::string_view text, F &&func) {
+  while (!text.empty()) {
+    auto end = text.find('\n');
+    auto line = text.substr(0, end);
+    if (!line.empty() && line.back() == '\r')
+      line.remove_suffix(1);
+    func(line);
+    if (end == std::string_view::npos)
+      break;
+    text.remove_prefix(end + 1);
+  }
+}
+
+inline void skip_space(std::string_view &text) {
+  while (!text.empty() && (text.front() == ' ' || text.front() == '\t'))
+    text.remove_prefix(1);
+}
+
+// Pops the next whitespace-delimited token from `text`.
+inline std::string_view next_token(std::string_view &text) {
+  skip_space(text);
+  size_t end = 0;
+  while (end < text.size() && text[end] != ' ' && text[end] != '\t')
+    ++end;
+  auto token = text.substr(0, end);
+  text.remove_prefix(end);
+  return token;
+}
+
+template <typename T> T parse_number(std::string_view token, size_t line_no) {
+  T value{};
+  auto [ptr, ec] =
+      std::from_chars(token.data(), token.data() + token.size(), value);
+  if (ec != std::errc{})
+    throw std::runtime_error(fmt::format(
+        "OBJ line {}: cannot parse '{}' as a number.", line_no, token
+    ));
+  return value;
+}
+
+} // namespace detail
+
+// Loads the triangles of a Wavefront OBJ file. Only `v` and `f` statements are
+// used; faces with more than three corners are fan-triangulated. The file is
+// memory-mapped and scanned twice: once to count vertices and triangles so the
+// buffers are allocated exactly once, then again to fill them. Files without
+// faces are rejected.
+[[nodiscard]] inline TriangleMesh load_obj(const std::string &path) {
+  MappedFile file(path);
+  auto text = file.view();
+
+  size_t vertex_count = 0, triangle_count = 0;
+  detail::for_each_line(text, [&](std::string_view line) {
+    detail::skip_space(line);
+    if (line.starts_with("v ") || line.starts_with("v\t")) {
+      ++vertex_count;
+    } else if (line.starts_with("f ") || line.starts_with("f\t")) {
+      line.remove_prefix(1);
+      size_t corners = 0;
+      while (!detail::next_token(line).empty())
+        ++corners;
+      if (corners >= 3)
+        triangle_count += corners - 2;
+    }
+  });
+
+  std::vector<TriangleMesh::Vertex> vertices;
+  std::vector<TriangleMesh::Triangle> triangles;
+  vertices.reserve(vertex_count);
+  triangles.reserve(triangle_count);
+
+  size_t line_no = 0;
+  detail::for_each_line(text, [&](std::string_view line) {
+    ++line_no;
+    detail::skip_space(line);
+    if (line.starts_with("v ") || line.starts_with("v\t")) {
+      line.remove_prefix(1);
+      TriangleMesh::Vertex vertex{};
+      for (auto &coord : vertex)
+        coord = detail::parse_number<float>(detail::next_token(line), line_no);
+      vertices.push_back(vertex);
+    } else if (line.starts_with("f ") || line.starts_with("f\t")) {
+      line.remove_prefix(1);
+      // Resolves a `v`, `v/vt`, `v//vn` or `v/vt/vn` corner to a 0-based
+      // vertex index. Negative indices count back from the latest vertex.
+      auto corner = [&](std::string_view token) -> uint32_t {
+        auto index = detail::parse_number<int64_t>(
+            token.substr(0, token.find('/')), line_no
+        );
+        auto resolved = index < 0 ? (int64_t)vertices.size() + index
+                                  : index - 1;
+        if (resolved < 0 || resolved >= (int64_t)vertices.size())
+          throw std::runtime_error(fmt::format(
+              "OBJ line {}: vertex index {} is out of range.", line_no, index
+          ));
+        return (uint32_t)resolved;
+      };
+
+      auto first_token = detail::next_token(line);
+      auto second_token = detail::next_token(line);
+      if (first_token.empty() || second_token.empty())
+        return;
+      auto first = corner(first_token);
+      auto previous = corner(second_token);
+      for (auto token = detail::next_token(line); !token.empty();
+           token = detail::next_token(line)) {
+        auto current = corner(token);
+        triangles.push_back({first, previous, current});
+        previous = current;
+      }
+    }
+  });
+
+  if (triangles.empty())
+    throw std::runtime_error(fmt::format("OBJ '{}' has no faces.", path));
+  return {std::move(vertices), std::move(triangles)};
+}
+
+#endif
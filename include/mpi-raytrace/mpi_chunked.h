@@ -0,0 +1,48 @@
+#ifndef MPI_CHUNKED_H
+#define MPI_CHUNKED_H
+
+#include <algorithm>
+#include <climits>
+#include <cstddef>
+#include <span>
+
+#include <mpi.h>
+
+// Point-to-point transfers of any length. MPI counts are `int`, so longer
+// buffers go out as a series of messages no longer than `MPI_CHUNK`
+// elements, which the receiver takes apart the same way.
+
+inline constexpr size_t MPI_CHUNK = size_t{1} << 27;
+static_assert(MPI_CHUNK <= INT_MAX);
+
+template <typename T>
+void send_chunked(
+    std::span<const T> data, MPI_Datatype type, int dest, int tag,
+    MPI_Comm comm
+) {
+  for (size_t offset = 0; offset < data.size(); offset += MPI_CHUNK) {
+    auto count = std::min(MPI_CHUNK, data.size() - offset);
+    MPI_Send(data.data() + offset, (int)count, type, dest, tag, comm);
+  }
+}
+
+// Receives what `send_chunked` sent with the same length and `type`.
+template <typename T>
+void receive_chunked(
+    std::span<T> data, MPI_Datatype type, int source, int tag, MPI_Comm comm
+) {
+  for (size_t offset = 0; offset < data.size(); offset += MPI_CHUNK) {
+    auto count = std::min(MPI_CHUNK, data.size() - offset);
+    MPI_Recv(
+        data.data() + offset,
+        (int)count,
+        type,
+        source,
+        tag,
+        comm,
+        MPI_STATUS_IGNORE
+    );
+  }
+}
+
+#endif
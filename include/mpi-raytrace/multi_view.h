@@ -0,0 +1,201 @@
+#ifndef MULTI_VIEW_H
+#define MULTI_VIEW_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include "camera.h"
+#include "color.h"
+#include "hittable.h"
+#include "lights.h"
+#include "numa.h"
+#include "render_server.h"
+#include "trace.h"
+#include "view.h"
+
+// Renders several views of one scene in a single pass. The row chunks of
+// all views form one queue that every render thread takes from, so the
+// scene is built once, and threads go on to the next view instead of
+// idling while the last rows of one view finish.
+
+// A camera of a multi-view render and the file its image goes to.
+struct ViewJob {
+  View view;
+  std::string output;
+};
+
+// Reads a view list: one view per line as space separated `key=value`
+// pairs, for example:
+//
+//   from=0,0,0 at=0,0,-1 up=0,1,0 vfov=90 out=front.ppm
+//
+// `out` is required, omitted view keys default as for `View`. Empty lines
+// and lines starting with `#` are skipped.
+[[nodiscard]] inline std::vector<ViewJob>
+read_view_list(const std::string &path) {
+  std::ifstream file(path);
+  if (!file)
+    throw std::runtime_error(fmt::format("Cannot read views '{}'.", path));
+
+  std::vector<ViewJob> views;
+  size_t number = 0;
+  for (std::string line; std::getline(file, line);) {
+    ++number;
+    if (line.empty() || line.starts_with('#'))
+      continue;
+    try {
+      ViewJob job;
+      for (auto field : detail::split(line, ' ')) {
+        auto eq = field.find('=');
+        if (eq == std::string_view::npos)
+          throw std::invalid_argument(
+              fmt::format("Expected key=value, got '{}'.", field)
+          );
+        auto key = field.substr(0, eq);
+        auto value = field.substr(eq + 1);
+        if (key == "out")
+          job.output = value;
+        else if (!parse_view_field(job.view, key, value))
+          throw std::invalid_argument(fmt::format("Unknown key '{}'.", key));
+      }
+      if (job.output.empty())
+        throw std::invalid_argument("Every view needs an 'out' file.");
+      job.view.validate();
+      views.push_back(std::move(job));
+    } catch (const std::invalid_argument &err) {
+      throw std::invalid_argument(
+          fmt::format("{}:{}: {}", path, number, err.what())
+      );
+    }
+  }
+  if (views.empty())
+    throw std::invalid_argument(fmt::format("'{}' lists no views.", path));
+  return views;
+}
+
+// A view being rendered.
+struct ViewTarget {
+  std::unique_ptr<Camera> camera;
+  std::string output;
+};
+
+// Renders every view in `views` with `total_threads` threads, handing out
+// chunks of `chunk_rows` rows of all views by `schedule`, view after view.
+// Whichever thread finishes the last chunk of a view writes its image and
+// releases it, while the others render on. Threads are placed by
+// `placement` if given, as for `Camera::render_region`.
+inline void render_views(
+    const Hittable &world, std::span<const ViewTarget> views,
+    size_t total_threads, size_t chunk_rows, RowSchedule schedule,
+    const ThreadPlacement *placement = nullptr
+) {
+  if (chunk_rows == 0)
+    throw std::invalid_argument("Chunks must have at least one row.");
+
+  // First chunk of every view, and one past the last.
+  std::vector<size_t> first_chunk{0};
+  for (const auto &target : views) {
+    auto height = target.camera->dimensions()[1];
+    first_chunk.push_back(
+        first_chunk.back() + (height + chunk_rows - 1) / chunk_rows
+    );
+  }
+  const size_t chunks = first_chunk.back();
+
+  std::vector<std::vector<std::vector<Color>>> images(views.size());
+  std::vector<std::atomic<size_t>> rows_left(views.size());
+  for (size_t view = 0; view < views.size(); ++view) {
+    auto height = views[view].camera->dimensions()[1];
+    images[view].resize(height);
+    rows_left[view].store(height, std::memory_order_relaxed);
+  }
+
+  auto write_view = [&](size_t view) {
+    TraceSpan span("encode");
+    const auto &target = views[view];
+    std::ofstream out(target.output);
+    if (!out)
+      throw std::runtime_error(
+          fmt::format("Cannot write view '{}'.", target.output)
+      );
+    target.camera->encode(out, images[view]);
+    images[view] = {};
+    std::clog << fmt::format("Wrote view {} to {}.\n", view, target.output);
+  };
+
+  std::atomic<size_t> next_chunk(0);
+  auto run = [&](size_t thread_idx, const Hittable &thread_world) {
+    Lights lights;
+    thread_world.collect_lights(lights);
+
+    for (size_t claimed = 0;; ++claimed) {
+      size_t chunk =
+          schedule == RowSchedule::dynamic
+              ? next_chunk.fetch_add(1, std::memory_order_acq_rel)
+              : thread_idx + claimed * total_threads;
+      if (chunk >= chunks)
+        break;
+      size_t view = (size_t)(std::ranges::upper_bound(first_chunk, chunk) -
+                             first_chunk.begin()) -
+                    1;
+      auto &camera = *views[view].camera;
+      auto &image = images[view];
+      auto region = camera.full_region();
+      size_t start = (chunk - first_chunk[view]) * chunk_rows;
+      size_t end = std::min(start + chunk_rows, region.height);
+
+      // Allocated here for first touch, see `Camera::render_thread`.
+      for (size_t row = start; row < end; ++row)
+        image[row].resize(region.width);
+
+      {
+        TraceSpan span("render rows");
+        camera.render_rows(thread_world, lights, region, start, end, image);
+      }
+
+      if (rows_left[view].fetch_sub(end - start, std::memory_order_acq_rel) ==
+          end - start)
+        write_view(view);
+    }
+  };
+
+  auto start_time = std::chrono::steady_clock::now();
+  std::vector<std::future<void>> futures;
+  futures.reserve(total_threads);
+  for (size_t thread_idx = 0; thread_idx < total_threads; ++thread_idx)
+    futures.emplace_back(std::async(std::launch::async, [&, thread_idx] {
+      if (placement == nullptr) {
+        run(thread_idx, world);
+        return;
+      }
+      placement->pin(thread_idx);
+      run(thread_idx, placement->world_for(thread_idx, world));
+    }));
+
+  // Wait for every thread before rethrowing so none outlive `images`.
+  for (auto &future : futures)
+    future.wait();
+  for (auto &future : futures)
+    future.get();
+
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start_time;
+  std::clog << fmt::format(
+      "Rendered {} views in {:.3f} seconds.\n", views.size(), elapsed.count()
+  );
+}
+
+#endif
@@ -0,0 +1,234 @@
+#ifndef NUMA_H
+#define NUMA_H
+
+#include <algorithm>
+#include <charconv>
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <fmt/format.h>
+
+#include "hittable.h"
+
+// Parses a Linux CPU list such as "0-3,8,10-11".
+[[nodiscard]] inline std::vector<int> parse_cpu_list(std::string_view text) {
+  std::vector<int> cpus;
+  auto number = [&](std::string_view digits) {
+    int value{};
+    auto [ptr, ec] =
+        std::from_chars(digits.data(), digits.data() + digits.size(), value);
+    if (ec != std::errc{} || ptr != digits.data() + digits.size())
+      throw std::invalid_argument(fmt::format("Invalid CPU list '{}'.", text));
+    return value;
+  };
+
+  while (!text.empty() && text.back() == '\n')
+    text.remove_suffix(1);
+  for (auto range = text; !range.empty();) {
+    auto comma = range.find(',');
+    auto part = range.substr(0, comma);
+    range = comma == std::string_view::npos ? std::string_view{}
+                                            : range.substr(comma + 1);
+    if (part.empty())
+      continue;
+    auto dash = part.find('-');
+    auto first = number(part.substr(0, dash));
+    auto last =
+        dash == std::string_view::npos ? first : number(part.substr(dash + 1));
+    for (auto cpu = first; cpu <= last; ++cpu)
+      cpus.push_back(cpu);
+  }
+  return cpus;
+}
+
+// The NUMA nodes of this machine and the CPUs this process may run on in
+// each, discovered through sysfs. Machines without NUMA information are
+// treated as a single node.
+class NumaTopology {
+  std::vector<std::vector<int>> node_cpus;
+
+public:
+  [[nodiscard]] static NumaTopology detect() {
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (::sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+      for (size_t cpu = 0; cpu < std::thread::hardware_concurrency(); ++cpu)
+        CPU_SET(cpu, &allowed);
+
+    NumaTopology topology;
+    std::map<int, std::vector<int>> nodes;
+    std::error_code err;
+    for (const auto &entry : std::filesystem::directory_iterator(
+             "/sys/devices/system/node", err
+         )) {
+      auto name = entry.path().filename().string();
+      int node{};
+      if (!name.starts_with("node") ||
+          std::from_chars(name.data() + 4, name.data() + name.size(), node)
+                  .ec != std::errc{})
+        continue;
+      std::ifstream file(entry.path() / "cpulist");
+      std::string list;
+      std::getline(file, list);
+      for (auto cpu : parse_cpu_list(list))
+        if (CPU_ISSET(cpu, &allowed))
+          nodes[node].push_back(cpu);
+    }
+
+    for (auto &[node, cpus] : nodes)
+      if (!cpus.empty())
+        topology.node_cpus.push_back(std::move(cpus));
+
+    if (topology.node_cpus.empty()) {
+      topology.node_cpus.emplace_back();
+      for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+        if (CPU_ISSET(cpu, &allowed))
+          topology.node_cpus.front().push_back(cpu);
+    }
+    return topology;
+  }
+
+  [[nodiscard]] size_t node_count() const noexcept { return node_cpus.size(); }
+  [[nodiscard]] const std::vector<int> &cpus(size_t node) const {
+    return node_cpus.at(node);
+  }
+
+  [[nodiscard]] std::optional<size_t> node_of(int cpu) const {
+    for (size_t node = 0; node < node_cpus.size(); ++node)
+      if (std::ranges::find(node_cpus[node], cpu) != node_cpus[node].end())
+        return node;
+    return {};
+  }
+};
+
+// Restricts the calling thread to `cpus`.
+inline void pin_current_thread(const std::vector<int> &cpus) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (auto cpu : cpus)
+    CPU_SET(cpu, &set);
+  if (int err = ::pthread_setaffinity_np(::pthread_self(), sizeof(set), &set))
+    throw std::system_error(err, std::generic_category(), "pin thread");
+}
+
+// Decides which CPU each render thread runs on and, optionally, gives every
+// NUMA node its own replica of the scene.
+//
+// Policies: "none" leaves threads to the scheduler, "compact" fills one node
+// before the next, "scatter" deals threads round-robin over the nodes, and
+// anything else is an explicit CPU list assigned to threads in order.
+class ThreadPlacement {
+  NumaTopology topology;
+  std::vector<int> thread_cpus; // Empty when threads are not pinned.
+  std::vector<std::unique_ptr<const Hittable>> replicas; // Indexed by node.
+
+public:
+  ThreadPlacement(
+      NumaTopology topology, std::string_view policy, size_t n_threads
+  )
+      : topology(std::move(topology)) {
+    const auto &topo = this->topology;
+    if (policy == "none")
+      return;
+
+    if (policy == "compact") {
+      std::vector<int> all;
+      for (size_t node = 0; node < topo.node_count(); ++node)
+        all.insert(all.end(), topo.cpus(node).begin(), topo.cpus(node).end());
+      for (size_t i = 0; i < n_threads; ++i)
+        thread_cpus.push_back(all[i % all.size()]);
+    } else if (policy == "scatter") {
+      std::vector<size_t> next(topo.node_count());
+      for (size_t i = 0; i < n_threads; ++i) {
+        auto node = i % topo.node_count();
+        const auto &cpus = topo.cpus(node);
+        thread_cpus.push_back(cpus[next[node]++ % cpus.size()]);
+      }
+    } else {
+      auto cpus = parse_cpu_list(policy);
+      if (cpus.empty())
+        throw std::invalid_argument("Empty CPU list.");
+      for (auto cpu : cpus)
+        if (!topo.node_of(cpu).has_value())
+          throw std::invalid_argument(
+              fmt::format("CPU {} is not available to this process.", cpu)
+          );
+      for (size_t i = 0; i < n_threads; ++i)
+        thread_cpus.push_back(cpus[i % cpus.size()]);
+    }
+  }
+
+  [[nodiscard]] const NumaTopology &numa() const noexcept { return topology; }
+  [[nodiscard]] bool pinned() const noexcept { return !thread_cpus.empty(); }
+
+  [[nodiscard]] std::optional<size_t> node_of_thread(size_t thread) const {
+    if (thread_cpus.empty())
+      return {};
+    return topology.node_of(thread_cpus[thread % thread_cpus.size()]);
+  }
+
+  // Pins the calling thread as render thread number `thread`.
+  void pin(size_t thread) const {
+    if (!thread_cpus.empty())
+      pin_current_thread({thread_cpus[thread % thread_cpus.size()]});
+  }
+
+  // Builds one scene per node that render threads are placed on. Each build
+  // runs on a thread bound to that node, so the kernel's first-touch policy
+  // places the replica in node-local memory.
+  void replicate(
+      const std::function<std::unique_ptr<const Hittable>()> &build
+  ) {
+    replicas.clear();
+    replicas.resize(topology.node_count());
+    std::vector<std::future<void>> builders;
+    for (size_t node = 0; node < topology.node_count(); ++node) {
+      bool used = false;
+      for (size_t thread = 0; thread < thread_cpus.size(); ++thread)
+        used = used || node_of_thread(thread) == node;
+      if (!used)
+        continue;
+      builders.push_back(std::async(std::launch::async, [&, node] {
+        pin_current_thread(topology.cpus(node));
+        replicas[node] = build();
+      }));
+    }
+    for (auto &builder : builders)
+      builder.wait();
+    for (auto &builder : builders)
+      builder.get();
+  }
+
+  [[nodiscard]] size_t replica_count() const noexcept {
+    return (size_t)std::ranges::count_if(replicas, [](const auto &replica) {
+      return replica != nullptr;
+    });
+  }
+
+  // The scene render thread number `thread` should trace against.
+  [[nodiscard]] const Hittable &
+  world_for(size_t thread, const Hittable &fallback) const {
+    auto node = node_of_thread(thread);
+    if (node.has_value() && replicas.size() > *node && replicas[*node])
+      return *replicas[*node];
+    return fallback;
+  }
+};
+
+#endif
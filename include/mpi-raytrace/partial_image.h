@@ -0,0 +1,101 @@
+#ifndef PARTIAL_IMAGE_H
+#define PARTIAL_IMAGE_H
+
+#include <cstddef>
+#include <istream>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include "color.h"
+#include "resolve.h"
+#include "thread_pool.h"
+#include "view.h"
+
+// A rendered crop window of a larger frame.
+//
+// Partials are written as ordinary PPM3 images carrying a header comment
+// `# crop <x> <y> <full width> <full height>`, so they stay viewable on their
+// own and several of them can be concatenated into one stream.
+struct PartialImage {
+  Region region;
+  size_t full_width = 0, full_height = 0;
+  size_t max_value = 255;     // Largest output value, from the header.
+  std::vector<double> values; // Row-major, 3 output values per pixel.
+};
+
+// Outputs `image`, rendered for `region` of a `full_width`x`full_height`
+// frame, as a partial PPM3 image.
+inline void write_partial_image(
+    std::ostream &out, const std::vector<std::vector<Color>> &image,
+    const Region &region, size_t full_width, size_t full_height,
+    const ResolveOptions &opts = {}, ThreadPool *pool = nullptr
+) {
+  auto resolved = resolve_image(image, opts, pool);
+  out << "P3\n"
+      << "# crop " << region.x << ' ' << region.y << ' ' << full_width << ' '
+      << full_height << '\n'
+      << region.width << ' ' << region.height << '\n'
+      << resolved.max_value << '\n';
+  write_pixels(out, resolved, pool);
+}
+
+// Reads every partial image in `in`. Plain PPM3 images without a crop comment
+// are treated as covering their whole frame.
+[[nodiscard]] inline std::vector<PartialImage>
+read_partial_images(std::istream &in) {
+  std::vector<PartialImage> partials;
+
+  // Reads the next header token, collecting `# crop` comments on the way.
+  auto next_token = [&](PartialImage &partial, bool &has_crop) {
+    std::string token;
+    while (in >> token) {
+      if (!token.starts_with('#'))
+        return token;
+      std::string comment;
+      std::getline(in, comment);
+      std::istringstream fields(token.substr(1) + comment);
+      std::string kind;
+      if (fields >> kind && kind == "crop" &&
+          fields >> partial.region.x >> partial.region.y >>
+              partial.full_width >> partial.full_height)
+        has_crop = true;
+    }
+    return std::string{};
+  };
+
+  for (;;) {
+    PartialImage partial;
+    bool has_crop = false;
+    auto magic = next_token(partial, has_crop);
+    if (magic.empty())
+      break;
+    if (magic != "P3")
+      throw std::runtime_error(
+          fmt::format("Expected a PPM3 image, found '{}'.", magic)
+      );
+
+    partial.region.width = std::stoul(next_token(partial, has_crop));
+    partial.region.height = std::stoul(next_token(partial, has_crop));
+    partial.max_value = std::stoul(next_token(partial, has_crop));
+    if (!has_crop) {
+      partial.full_width = partial.region.width;
+      partial.full_height = partial.region.height;
+    }
+
+    partial.values.resize(partial.region.width * partial.region.height * 3);
+    for (auto &value : partial.values)
+      if (!(in >> value))
+        throw std::runtime_error("Truncated PPM3 image data.");
+
+    partials.push_back(std::move(partial));
+  }
+
+  return partials;
+}
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef PLANE_H
+#define PLANE_H
+
+#include <cmath>
+#include <optional>
+#include <utility>
+
+#include "hittable.h"
+#include "interval.h"
+#include "material.h"
+#include "ray.h"
+#include "vec.h"
+
+// An infinite plane through a point. It has no bounding box, so
+// acceleration structures test it apart from their hierarchy.
+class Plane : public Hittable {
+  Point3 plane_point;
+  Vec3 plane_normal; // Unit length, pointing to the front side.
+  Material plane_material;
+
+public:
+  Plane(Point3 point, const Vec3 &normal, Material material = {})
+      : plane_point(std::move(point)),
+        plane_normal(blaze::normalize(normal)),
+        plane_material(std::move(material)) {}
+
+  [[nodiscard]] const Point3 &point() const noexcept { return plane_point; }
+  [[nodiscard]] const Vec3 &normal() const noexcept { return plane_normal; }
+  [[nodiscard]] const Material &material() const noexcept {
+    return plane_material;
+  }
+
+  // Distance along `ray` to the plane through `point` with unit `normal`,
+  // if the ray crosses it inside `ray_t`.
+  [[gnu::hot]] [[nodiscard]]
+  static std::optional<double> distance(
+      const Point3 &point, const Vec3 &normal, const Ray &ray,
+      Interval<double> ray_t
+  ) {
+    auto facing = blaze::dot(normal, ray.direction());
+    if (std::abs(facing) < 1e-12) // Parallel to the plane.
+      return {};
+    auto time = blaze::dot(normal, Vec3(point - ray.origin())) / facing;
+    if (!ray_t.surrounds(time))
+      return {};
+    return time;
+  }
+
+  [[gnu::hot]] [[nodiscard]]
+  static std::optional<HitRecord> intersect(
+      const Point3 &point, const Vec3 &normal, const Ray &ray,
+      Interval<double> ray_t
+  ) {
+    auto time = distance(point, normal, ray, ray_t);
+    if (!time.has_value())
+      return {};
+    return HitRecord::from_face_normal(ray, *time, normal);
+  }
+
+  [[nodiscard]] std::optional<HitRecord>
+  hit(const Ray &ray, Interval<double> ray_t) const override {
+    auto record = intersect(plane_point, plane_normal, ray, ray_t);
+    if (record.has_value())
+      record->material = &plane_material;
+    return record;
+  }
+};
+
+#endif
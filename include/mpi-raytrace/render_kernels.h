@@ -0,0 +1,250 @@
+#ifndef RENDER_KERNELS_H
+#define RENDER_KERNELS_H
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <numbers>
+#include <optional>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "color.h"
+#include "hittable.h"
+#include "interval.h"
+#include "lights.h"
+#include "ray.h"
+#include "sampling.h"
+#include "vec.h"
+
+// Trace kernels shared by the threaded and MPI cameras.
+//
+// Besides the generic kernel that takes the bounce depth at runtime, kernels
+// are instantiated for every combination of a power-of-two sample count up to
+// `MAX_KERNEL_SAMPLES` and a bounce depth up to `MAX_KERNEL_BOUNCES`. Those
+// have constant trip counts and the path loop inlined with its depth known.
+
+inline constexpr size_t MAX_KERNEL_SAMPLES = 64;
+inline constexpr size_t MAX_KERNEL_BOUNCES = 8;
+
+namespace kernels {
+
+constexpr auto EPSILON = 0.001; // shadow acne fix
+
+// Color of a ray that escapes the scene.
+[[nodiscard]] inline Color background(const Ray &ray) {
+  Vec3 unit_direction = Vec3{blaze::normalize(ray.direction())};
+  auto coeff_a = 0.5 * (unit_direction.y() + 1.0);
+  return Color{
+      (1.0 - coeff_a) * Color{1.0, 1.0, 1.0} + coeff_a * Color{0.5, 0.7, 1.0}
+  };
+}
+
+// A path between two bounces.
+struct PathState {
+  Ray ray; // Continues the path.
+  Color throughput{1, 1, 1};
+  double scatter_pdf = 0; // Zero while no surface has been scattered off.
+  Point3 scatter_origin{0, 0, 0};
+};
+
+// Extends `path` by one vertex, adding the light found there to `radiance`,
+// and scatters its ray onwards. Hits add direct light from a shadow ray
+// towards one of `lights`, then scatter into a cosine weighted direction.
+// Emission reached by scattering is weighed against the light sample with
+// the power heuristic. No light is sampled at the `last` vertex, which
+// would need a segment more than the depth allows. Returns whether the path
+// goes on.
+[[gnu::hot]] [[nodiscard]] [[gnu::always_inline]]
+inline bool extend_path(
+    PathState &path, bool last, const Hittable &world, const Lights &lights,
+    Color &radiance
+) {
+  auto rec = world.hit(path.ray, Interval(EPSILON, infinity));
+  if (!rec.has_value()) {
+    radiance += path.throughput * background(path.ray);
+    return false;
+  }
+  const auto &material = *rec->material;
+
+  if (material.emissive() && rec->is_frontface) {
+    auto weight =
+        path.scatter_pdf > 0
+            ? power_heuristic(
+                  path.scatter_pdf,
+                  lights.pdf(path.scatter_origin, rec->material)
+              )
+            : 1.0;
+    radiance += weight * path.throughput * material.emission;
+  }
+  if (last)
+    return false;
+
+  auto brdf = Color(material.albedo * std::numbers::inv_pi);
+
+  // Next event estimation.
+  if (auto light = lights.sample(rec->point); light.has_value()) {
+    auto cos_theta = blaze::dot(rec->normal, light->direction);
+    if (cos_theta > 0) {
+      auto shadow = world.hit(
+          Ray(rec->point, light->direction),
+          Interval(EPSILON, light->distance)
+      );
+      if (shadow.has_value() && shadow->material == light->material &&
+          shadow->is_frontface) {
+        auto weight = power_heuristic(
+            light->pdf, cosine_hemisphere_pdf(rec->normal, light->direction)
+        );
+        radiance += weight * cos_theta / light->pdf * path.throughput * brdf *
+                    light->material->emission;
+      }
+    }
+  }
+
+  // A cosine weighted direction cancels the cosine and the 1/pi of the
+  // Lambertian BRDF, leaving only the albedo.
+  auto [direction, pdf] = sample_cosine_hemisphere(rec->normal);
+  path.throughput *= material.albedo;
+  path.scatter_pdf = pdf;
+  path.scatter_origin = rec->point;
+  path.ray = Ray(rec->point, direction);
+  return true;
+}
+
+// Light arriving along `ray` from at most `depth` bounces of a path through
+// `world`, see `extend_path`.
+[[gnu::hot]] [[nodiscard]] [[gnu::always_inline]]
+inline Color
+ray_color(Ray ray, size_t depth, const Hittable &world, const Lights &lights) {
+  Color radiance{0, 0, 0};
+  PathState path{std::move(ray)};
+  for (; depth > 0; --depth)
+    if (!extend_path(path, depth == 1, world, lights, radiance))
+      break;
+  return radiance;
+}
+
+// `ray_color` with the depth fixed at compile time. The bounce loop is
+// unrolled into `Depth` inlined copies of `extend_path`, each knowing
+// whether it is the last, so the last one drops light sampling and
+// scattering entirely.
+template <size_t Depth>
+[[gnu::hot]] [[nodiscard]]
+inline Color
+ray_color_fixed(const Ray &ray, const Hittable &world, const Lights &lights) {
+  Color radiance{0, 0, 0};
+  PathState path{ray};
+  [&]<size_t... Vertex>(std::index_sequence<Vertex...>) {
+    // `&&` stops at the first vertex that ends the path.
+    (void)(extend_path(path, Vertex + 1 == Depth, world, lights, radiance) &&
+           ...);
+  }(std::make_index_sequence<Depth>{});
+  return radiance;
+}
+
+// Paths traced together by `trace_reordered`; callers split larger batches.
+inline constexpr size_t REORDER_BATCH = size_t{1} << 16;
+
+// Spreads the low 10 bits of `v` out to every third bit.
+constexpr uint32_t spread_bits(uint32_t v) {
+  v &= 0x3ff;
+  v = (v | (v << 16)) & 0x030000ff;
+  v = (v | (v << 8)) & 0x0300f00f;
+  v = (v | (v << 4)) & 0x030c30c3;
+  v = (v | (v << 2)) & 0x09249249;
+  return v;
+}
+static_assert(spread_bits(0x1ff) << 2 < (uint32_t{1} << 27));
+
+// Sort key that groups rays by the octant of their direction, then orders
+// them along a Morton curve through a 512^3 grid of origin cells. The
+// octant takes bits 27 to 29 above the 27 Morton bits.
+[[nodiscard]] inline uint32_t coherence_key(
+    const Ray &ray, const std::array<double, 3> &lo,
+    const std::array<double, 3> &scale
+) {
+  uint32_t octant = 0;
+  uint32_t morton = 0;
+  for (size_t axis = 0; axis < 3; ++axis) {
+    octant |= (uint32_t)(ray.direction()[axis] < 0) << axis;
+    auto cell = std::clamp(
+        (ray.origin()[axis] - lo[axis]) * scale[axis], 0.0, 511.0
+    );
+    morton |= spread_bits((uint32_t)cell) << axis;
+  }
+  return octant << 27 | morton;
+}
+
+// Traces `paths` like `ray_color` would, adding each one's light to the
+// matching entry of `radiance`, but a bounce at a time: all paths take
+// their first bounce, then the survivors are sorted by `coherence_key` and
+// take their second in that order, and so on. Neighbouring rays then visit
+// the same parts of the scene one after another, so its data tends to still
+// be in cache.
+[[gnu::hot]] inline void trace_reordered(
+    std::span<PathState> paths, size_t depth, const Hittable &world,
+    const Lights &lights, std::span<Color> radiance
+) {
+  // Sort key in the upper and path index in the lower half.
+  thread_local std::vector<uint64_t> order;
+  order.clear();
+  for (size_t i = 0; i < paths.size(); ++i)
+    order.push_back(i);
+  auto path_of = [](uint64_t entry) { return (uint32_t)entry; };
+
+  for (size_t bounce = 0; bounce < depth && !order.empty(); ++bounce) {
+    if (bounce > 0) {
+      // Key origins within the box of this bounce's origins.
+      std::array<double, 3> lo{infinity, infinity, infinity};
+      std::array<double, 3> hi{-infinity, -infinity, -infinity};
+      for (auto entry : order)
+        for (size_t axis = 0; axis < 3; ++axis) {
+          const auto &origin = paths[path_of(entry)].ray.origin();
+          lo[axis] = std::min(lo[axis], origin[axis]);
+          hi[axis] = std::max(hi[axis], origin[axis]);
+        }
+      std::array<double, 3> scale{};
+      for (size_t axis = 0; axis < 3; ++axis)
+        scale[axis] = hi[axis] > lo[axis] ? 512.0 / (hi[axis] - lo[axis]) : 0;
+      for (auto &entry : order)
+        entry = (uint64_t)coherence_key(paths[path_of(entry)].ray, lo, scale)
+                    << 32 |
+                path_of(entry);
+      std::ranges::sort(order);
+    }
+
+    auto last = bounce + 1 == depth;
+    std::erase_if(order, [&](uint64_t entry) {
+      auto i = path_of(entry);
+      return !extend_path(paths[i], last, world, lights, radiance[i]);
+    });
+  }
+}
+
+constexpr size_t SAMPLE_VARIANTS = std::countr_zero(MAX_KERNEL_SAMPLES) + 1;
+
+// Position of the specialized kernel for a configuration, if there is one.
+[[nodiscard]] constexpr std::optional<size_t>
+index(size_t samples, size_t bounces) {
+  if (!std::has_single_bit(samples) || samples > MAX_KERNEL_SAMPLES ||
+      bounces == 0 || bounces > MAX_KERNEL_BOUNCES)
+    return {};
+  return (size_t)std::countr_zero(samples) * MAX_KERNEL_BOUNCES + bounces - 1;
+}
+
+// Builds the table of specialized kernels, calling
+// `Make::template kernel<Samples, Bounces>()` for every configuration.
+template <typename Make> consteval auto table() {
+  return []<size_t... I>(std::index_sequence<I...>) {
+    return std::array{Make::template kernel<
+        (size_t{1} << (I / MAX_KERNEL_BOUNCES)),
+        I % MAX_KERNEL_BOUNCES + 1>()...};
+  }(std::make_index_sequence<SAMPLE_VARIANTS * MAX_KERNEL_BOUNCES>{});
+}
+
+} // namespace kernels
+
+#endif
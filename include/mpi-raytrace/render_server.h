@@ -0,0 +1,411 @@
+#ifndef RENDER_SERVER_H
+#define RENDER_SERVER_H
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <semaphore>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <fmt/format.h>
+
+#include "camera.h"
+#include "color.h"
+#include "hittable.h"
+#include "partial_image.h"
+#include "resolve.h"
+#include "thread_pool.h"
+#include "vec.h"
+#include "view.h"
+
+// One render request. Sent to the server as a single line of space separated
+// `key=value` pairs, for example:
+//
+//   width=640 height=360 rays=8 bounces=4 scene=a.obj,b.obj
+//   from=0,1,2 at=0,0,-4 up=0,1,0 vfov=60 region=0,0,320,180
+//
+// Omitted keys keep the server's defaults. `scene` lists the OBJ meshes to add
+// to the built-in world, `region` is `x,y,width,height` in full image pixels.
+struct RenderJob {
+  size_t width = 1920;
+  size_t height = 1080;
+  size_t rays_per_pixel = 32;
+  size_t max_bounces = 4;
+  std::string scene;
+  View view;
+  std::optional<Region> region;
+  ResolveOptions resolve; // Not settable per job, follows the server.
+
+  // Largest image a job may ask for, bounding what one request allocates.
+  static constexpr size_t MAX_PIXELS = size_t{1} << 25;
+};
+
+namespace detail {
+
+inline std::vector<std::string_view> split(std::string_view text, char sep) {
+  std::vector<std::string_view> parts;
+  while (!text.empty()) {
+    auto end = text.find(sep);
+    if (end != 0)
+      parts.push_back(text.substr(0, end));
+    if (end == std::string_view::npos)
+      break;
+    text.remove_prefix(end + 1);
+  }
+  return parts;
+}
+
+template <typename T>
+T parse_value(std::string_view key, std::string_view text) {
+  T value{};
+  auto [ptr, ec] =
+      std::from_chars(text.data(), text.data() + text.size(), value);
+  if (ec != std::errc{} || ptr != text.data() + text.size())
+    throw std::invalid_argument(
+        fmt::format("Invalid value '{}' for '{}'.", text, key)
+    );
+  return value;
+}
+
+template <typename T, size_t N>
+std::array<T, N> parse_tuple(std::string_view key, std::string_view text) {
+  auto parts = split(text, ',');
+  if (parts.size() != N)
+    throw std::invalid_argument(
+        fmt::format("'{}' takes {} comma separated values.", key, N)
+    );
+  std::array<T, N> values{};
+  for (size_t i = 0; i < N; ++i)
+    values[i] = parse_value<T>(key, parts[i]);
+  return values;
+}
+
+} // namespace detail
+
+// Applies a `from`, `at`, `up` or `vfov` field to `view`. Returns whether
+// `key` was one of those.
+inline bool
+parse_view_field(View &view, std::string_view key, std::string_view value) {
+  auto to_point = [](std::array<double, 3> xyz) {
+    return Point3{xyz[0], xyz[1], xyz[2]};
+  };
+  if (key == "from")
+    view.look_from = to_point(detail::parse_tuple<double, 3>(key, value));
+  else if (key == "at")
+    view.look_at = to_point(detail::parse_tuple<double, 3>(key, value));
+  else if (key == "up")
+    view.up = to_point(detail::parse_tuple<double, 3>(key, value));
+  else if (key == "vfov")
+    view.vfov = detail::parse_value<double>(key, value);
+  else
+    return false;
+  return true;
+}
+
+// Parses a request line on top of `defaults`.
+[[nodiscard]] inline RenderJob
+parse_job(std::string_view line, RenderJob defaults) {
+  auto job = std::move(defaults);
+
+  for (auto field : detail::split(line, ' ')) {
+    auto eq = field.find('=');
+    if (eq == std::string_view::npos)
+      throw std::invalid_argument(
+          fmt::format("Expected key=value, got '{}'.", field)
+      );
+    auto key = field.substr(0, eq);
+    auto value = field.substr(eq + 1);
+
+    if (key == "width") {
+      job.width = detail::parse_value<size_t>(key, value);
+    } else if (key == "height") {
+      job.height = detail::parse_value<size_t>(key, value);
+    } else if (key == "rays") {
+      job.rays_per_pixel = detail::parse_value<size_t>(key, value);
+    } else if (key == "bounces") {
+      job.max_bounces = detail::parse_value<size_t>(key, value);
+    } else if (key == "scene") {
+      job.scene = value;
+    } else if (key == "region") {
+      auto rect = detail::parse_tuple<size_t, 4>(key, value);
+      job.region = Region{rect[0], rect[1], rect[2], rect[3]};
+    } else if (!parse_view_field(job.view, key, value)) {
+      throw std::invalid_argument(fmt::format("Unknown key '{}'.", key));
+    }
+  }
+
+  if (job.width == 0 || job.height == 0 || job.rays_per_pixel == 0)
+    throw std::invalid_argument("width, height and rays must be positive.");
+  if (job.width > RenderJob::MAX_PIXELS / job.height)
+    throw std::invalid_argument(fmt::format(
+        "Images are limited to {} pixels.", RenderJob::MAX_PIXELS
+    ));
+  job.view.validate();
+  if (job.region.has_value() &&
+      !job.region->fits_within(job.width, job.height))
+    throw std::invalid_argument("region must lie within the image.");
+
+  return job;
+}
+
+// Keeps built scenes and their acceleration structures resident between
+// jobs. Concurrent requests for a scene that is still being built wait for
+// the same build.
+class SceneCache {
+public:
+  using Scene = std::shared_ptr<const Hittable>;
+  using Factory = std::function<Scene(const std::string &)>;
+
+private:
+  Factory factory;
+  std::mutex mutex;
+  std::map<std::string, std::shared_future<Scene>, std::less<>> scenes;
+
+public:
+  explicit SceneCache(Factory factory) : factory(std::move(factory)) {}
+
+  [[nodiscard]] Scene get(const std::string &key) {
+    std::promise<Scene> promise;
+    std::shared_future<Scene> future;
+    bool build = false;
+    {
+      std::scoped_lock lock(mutex);
+      auto it = scenes.find(key);
+      if (it != scenes.end()) {
+        future = it->second;
+      } else {
+        future = promise.get_future().share();
+        scenes.emplace(key, future);
+        build = true;
+      }
+    }
+
+    if (build) {
+      try {
+        promise.set_value(factory(key));
+      } catch (...) {
+        promise.set_exception(std::current_exception());
+        // Let a later job retry instead of caching the failure.
+        std::scoped_lock lock(mutex);
+        scenes.erase(key);
+      }
+    }
+
+    return future.get();
+  }
+};
+
+// An owned file descriptor.
+class UniqueFd {
+  int fd = -1;
+
+public:
+  explicit UniqueFd(int fd) : fd(fd) {}
+  ~UniqueFd() {
+    if (fd >= 0)
+      ::close(fd);
+  }
+
+  UniqueFd(const UniqueFd &) = delete;
+  UniqueFd &operator=(const UniqueFd &) = delete;
+  UniqueFd(UniqueFd &&other) noexcept : fd(std::exchange(other.fd, -1)) {}
+  UniqueFd &operator=(UniqueFd &&) = delete;
+
+  [[nodiscard]] int get() const noexcept { return fd; }
+};
+
+// Serves render jobs over a Unix domain socket. Each connection sends one
+// job line and receives the rendered image as a PPM3 image, or a partial
+// image when it asked for a region, or a line starting with `error:`. Jobs
+// are split into row tiles that all run on one shared `ThreadPool`, so
+// concurrent jobs interleave instead of oversubscribing the machine.
+class RenderServer {
+  static constexpr size_t TILE_ROWS = 4;
+  static constexpr size_t MAX_REQUEST = 4096;
+  static constexpr ptrdiff_t MAX_CONNECTIONS = 32;
+
+  std::string socket_path;
+  UniqueFd listener;
+  ThreadPool &pool;
+  SceneCache &scenes;
+  RenderJob defaults;
+  // Connections are handled on `handlers`, at most `MAX_CONNECTIONS` at a
+  // time; further ones wait in the listen backlog. Declared last, so the
+  // handlers finish before anything they use is destroyed.
+  std::counting_semaphore<MAX_CONNECTIONS> free_handlers{MAX_CONNECTIONS};
+  ThreadPool handlers{MAX_CONNECTIONS};
+
+  static std::string read_line(int fd) {
+    std::string line;
+    std::array<char, 512> buffer{};
+    while (line.size() < MAX_REQUEST) {
+      auto got = ::recv(fd, buffer.data(), buffer.size(), 0);
+      if (got < 0 && errno == EINTR)
+        continue;
+      if (got <= 0)
+        break;
+      line.append(buffer.data(), (size_t)got);
+      if (line.find('\n') != std::string::npos)
+        break;
+    }
+    return line.substr(0, line.find_first_of("\r\n"));
+  }
+
+  static void send_all(int fd, std::string_view data) {
+    while (!data.empty()) {
+      auto sent = ::send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+      if (sent < 0 && errno == EINTR)
+        continue;
+      if (sent <= 0)
+        return; // The client went away.
+      data.remove_prefix((size_t)sent);
+    }
+  }
+
+  [[nodiscard]] std::string render(const RenderJob &job) {
+    auto world = scenes.get(job.scene);
+    auto camera = std::make_unique<Camera>(
+        (double)job.width,
+        (double)job.height,
+        job.rays_per_pixel,
+        job.max_bounces,
+        job.view
+    );
+    auto region = job.region.value_or(camera->full_region());
+
+    std::vector<std::vector<Color>> image(
+        region.height, std::vector<Color>(region.width)
+    );
+    std::vector<std::future<void>> tiles;
+    for (size_t first = 0; first < region.height; first += TILE_ROWS) {
+      auto last = std::min(first + TILE_ROWS, region.height);
+      tiles.push_back(pool.submit([&, first, last] {
+        camera->render_rows(*world, region, first, last, image);
+      }));
+    }
+    // Wait for every tile before rethrowing so none outlive `image`.
+    for (auto &tile : tiles)
+      tile.wait();
+    for (auto &tile : tiles)
+      tile.get();
+
+    std::ostringstream out;
+    if (job.region.has_value())
+      write_partial_image(
+          out, image, region, job.width, job.height, job.resolve, &pool
+      );
+    else
+      write_image(out, image, job.resolve, &pool);
+    return std::move(out).str();
+  }
+
+  void serve(UniqueFd connection) {
+    auto start_time = std::chrono::steady_clock::now();
+    auto line = read_line(connection.get());
+    try {
+      auto job = parse_job(line, defaults);
+      send_all(connection.get(), render(job));
+
+      std::chrono::duration<double> elapsed =
+          std::chrono::steady_clock::now() - start_time;
+      std::clog << fmt::format(
+          "Rendered '{}' in {} seconds.\n", line, elapsed.count()
+      );
+    } catch (const std::exception &err) {
+      send_all(connection.get(), fmt::format("error: {}\n", err.what()));
+      std::clog << fmt::format("Failed '{}': {}\n", line, err.what());
+    }
+  }
+
+public:
+  RenderServer(
+      std::string socket_path, ThreadPool &pool, SceneCache &scenes,
+      RenderJob defaults
+  )
+      : socket_path(std::move(socket_path)),
+        listener(::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)), pool(pool),
+        scenes(scenes), defaults(std::move(defaults)) {
+    // Jobs would wait forever on a pool without workers.
+    if (pool.size() == 0)
+      throw std::invalid_argument(
+          "The render server needs at least one thread."
+      );
+    if (listener.get() < 0)
+      throw std::system_error(errno, std::generic_category(), "socket");
+
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (this->socket_path.size() >= sizeof(addr.sun_path))
+      throw std::invalid_argument(
+          fmt::format("Socket path '{}' is too long.", this->socket_path)
+      );
+    std::ranges::copy(this->socket_path, std::begin(addr.sun_path));
+
+    // Replace a socket left behind by a previous server.
+    ::unlink(this->socket_path.c_str());
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    if (::bind(
+            listener.get(), reinterpret_cast<sockaddr *>(&addr), sizeof(addr)
+        ) != 0 ||
+        ::listen(listener.get(), SOMAXCONN) != 0)
+      throw std::system_error(
+          errno, std::generic_category(), this->socket_path
+      );
+  }
+
+  ~RenderServer() { ::unlink(socket_path.c_str()); }
+
+  RenderServer(const RenderServer &) = delete;
+  RenderServer(RenderServer &&) = delete;
+  RenderServer &operator=(const RenderServer &) = delete;
+  RenderServer &operator=(RenderServer &&) = delete;
+
+  // Accepts connections forever, handling each on a free handler thread.
+  // The handlers only parse, wait on the pool and write back the result.
+  [[noreturn]] void run() {
+    std::clog << fmt::format(
+        "Listening on {} with {} threads.\n", socket_path, pool.size()
+    );
+    for (;;) {
+      free_handlers.acquire();
+      int fd = ::accept4(listener.get(), nullptr, nullptr, SOCK_CLOEXEC);
+      if (fd < 0) {
+        free_handlers.release();
+        if (errno == EINTR || errno == ECONNABORTED)
+          continue;
+        throw std::system_error(errno, std::generic_category(), "accept");
+      }
+      (void)handlers.submit([this, connection = UniqueFd(fd)]() mutable {
+        try {
+          serve(std::move(connection));
+        } catch (...) {
+          free_handlers.release();
+          throw;
+        }
+        free_handlers.release();
+      });
+    }
+  }
+};
+
+#endif
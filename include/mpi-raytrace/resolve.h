@@ -0,0 +1,294 @@
+#ifndef RESOLVE_H
+#define RESOLVE_H
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <ostream>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#if __has_include(<experimental/simd>)
+#include <experimental/simd>
+#define RESOLVE_SIMD 1
+#endif
+
+#include <fmt/format.h>
+
+#include "color.h"
+#include "thread_pool.h"
+
+// Converts a linear framebuffer into quantized output values.
+//
+// The curve is applied to clamped linear values, which are then quantized to
+// the output bit depth. Rows are resolved independently, in parallel when a
+// `ThreadPool` is given, with the per-value work in SIMD registers.
+
+enum class ToneCurve {
+  linear, // No encoding.
+  gamma2, // Square root, the renderer's traditional output.
+  srgb,   // The piecewise sRGB transfer function.
+};
+
+[[nodiscard]] inline ToneCurve parse_tone_curve(std::string_view name) {
+  if (name == "linear")
+    return ToneCurve::linear;
+  if (name == "gamma2")
+    return ToneCurve::gamma2;
+  if (name == "srgb")
+    return ToneCurve::srgb;
+  throw std::invalid_argument(fmt::format(
+      "Unknown tone curve '{}', expected linear, gamma2 or srgb.", name
+  ));
+}
+
+struct ResolveOptions {
+  ToneCurve curve = ToneCurve::gamma2;
+  unsigned bit_depth = 8; // 8 or 16.
+  // Add an ordered dither before quantizing, trading banding for noise.
+  bool dither = false;
+
+  // Throws unless the bit depth is one the encoder writes.
+  void validate() const {
+    if (bit_depth != 8 && bit_depth != 16)
+      throw std::invalid_argument(
+          fmt::format("Bit depth must be 8 or 16, got {}.", bit_depth)
+      );
+  }
+
+  [[nodiscard]] uint32_t max_value() const {
+    validate();
+    return (uint32_t{1} << bit_depth) - 1;
+  }
+};
+
+// A quantized image, 3 values per pixel in row-major order.
+struct ResolvedImage {
+  size_t width = 0, height = 0;
+  uint32_t max_value = 255;
+  std::vector<uint16_t> values;
+};
+
+namespace detail {
+
+// 4x4 Bayer matrix as thresholds in (0, 1).
+constexpr auto BAYER = [] {
+  constexpr std::array<int, 16> ORDER{
+      0, 8, 2, 10, 12, 4, 14, 6, 3, 11, 1, 9, 15, 7, 13, 5
+  };
+  std::array<double, 16> thresholds{};
+  for (size_t i = 0; i < ORDER.size(); ++i)
+    thresholds[i] = (ORDER[i] + 0.5) / 16.0;
+  return thresholds;
+}();
+
+// Encodes linear values in [0, 1] with `curve`. Works on scalars and on
+// SIMD vectors alike.
+template <typename V> V apply_curve(V value, ToneCurve curve) {
+  using std::pow, std::sqrt;
+#ifdef RESOLVE_SIMD
+  using std::experimental::pow, std::experimental::sqrt;
+#endif
+  switch (curve) {
+  case ToneCurve::linear:
+    return value;
+  case ToneCurve::gamma2:
+    return sqrt(value);
+  case ToneCurve::srgb: {
+    V encoded = 1.055 * pow(value, V(1.0 / 2.4)) - 0.055;
+    if constexpr (std::is_floating_point_v<V>) {
+      return value <= 0.0031308 ? 12.92 * value : encoded;
+    } else {
+      where(value <= 0.0031308, encoded) = 12.92 * value;
+      return encoded;
+    }
+  }
+  }
+  return value;
+}
+
+// Maps encoded `value` to an integer level in [0, `max_level`], adding the
+// dither `threshold` when dithering.
+template <typename V>
+V quantize(V value, double max_level, V threshold, bool dither) {
+  using std::floor, std::min, std::max;
+#ifdef RESOLVE_SIMD
+  using std::experimental::floor, std::experimental::min,
+      std::experimental::max;
+#endif
+  V level = dither ? value * max_level + threshold : value * (max_level + 1);
+  return min(max(floor(level), V(0.0)), V(max_level));
+}
+
+template <typename V>
+V resolve_value(
+    V linear, double max_level, V threshold, const ResolveOptions &opts
+) {
+  using std::min, std::max;
+#ifdef RESOLVE_SIMD
+  using std::experimental::min, std::experimental::max;
+#endif
+  auto clamped = min(max(linear, V(0.0)), V(1.0));
+  return quantize(
+      apply_curve(clamped, opts.curve), max_level, threshold, opts.dither
+  );
+}
+
+// Resolves image row `y` into `out`, 3 values per pixel.
+[[gnu::hot]] inline void resolve_row(
+    std::span<const Color> row, size_t y, const ResolveOptions &opts,
+    std::span<uint16_t> out
+) {
+  const double max_level = opts.max_value();
+  thread_local std::vector<double> values, thresholds;
+  values.resize(row.size() * 3);
+  thresholds.resize(opts.dither ? values.size() : 0);
+
+  for (size_t x = 0; x < row.size(); ++x)
+    for (size_t channel = 0; channel < 3; ++channel)
+      values[x * 3 + channel] = row[x][channel];
+  if (opts.dither)
+    for (size_t x = 0; x < row.size(); ++x)
+      for (size_t channel = 0; channel < 3; ++channel)
+        thresholds[x * 3 + channel] = BAYER[(y % 4) * 4 + x % 4];
+
+  size_t i = 0;
+#ifdef RESOLVE_SIMD
+  namespace stdx = std::experimental;
+  using V = stdx::native_simd<double>;
+  for (; i + V::size() <= values.size(); i += V::size()) {
+    V linear(&values[i], stdx::element_aligned);
+    V threshold = opts.dither ? V(&thresholds[i], stdx::element_aligned)
+                              : V(0.0);
+    resolve_value(linear, max_level, threshold, opts)
+        .copy_to(&values[i], stdx::element_aligned);
+  }
+#endif
+  for (; i < values.size(); ++i)
+    values[i] = resolve_value(
+        values[i], max_level, opts.dither ? thresholds[i] : 0.0, opts
+    );
+
+  for (i = 0; i < values.size(); ++i)
+    out[i] = (uint16_t)values[i];
+}
+
+} // namespace detail
+
+// Resolves `image`, spreading bands of rows over `pool` if there is one.
+// `image` may be a band of a larger frame starting at row `first_row`, which
+// keeps the dither pattern continuous across bands.
+[[nodiscard]] inline ResolvedImage resolve_image(
+    std::span<const std::vector<Color>> image, const ResolveOptions &opts,
+    ThreadPool *pool = nullptr, size_t first_row = 0
+) {
+  constexpr size_t BAND_ROWS = 16;
+
+  ResolvedImage resolved;
+  resolved.height = image.size();
+  resolved.width = image.empty() ? 0 : image.front().size();
+  resolved.max_value = opts.max_value();
+  resolved.values.resize(resolved.width * resolved.height * 3);
+
+  auto resolve_band = [&](size_t first, size_t last) {
+    for (auto y = first; y < last; ++y)
+      detail::resolve_row(
+          image[y],
+          first_row + y,
+          opts,
+          std::span(resolved.values)
+              .subspan(y * resolved.width * 3, resolved.width * 3)
+      );
+  };
+
+  if (pool == nullptr) {
+    resolve_band(0, resolved.height);
+    return resolved;
+  }
+
+  std::vector<std::future<void>> bands;
+  for (size_t first = 0; first < resolved.height; first += BAND_ROWS)
+    bands.push_back(pool->submit([&, first] {
+      resolve_band(first, std::min(first + BAND_ROWS, resolved.height));
+    }));
+  for (auto &band : bands)
+    band.wait();
+  for (auto &band : bands)
+    band.get();
+  return resolved;
+}
+
+// Outputs the pixel values of `image` as PPM3 text, formatting bands of
+// rows on `pool` if there is one.
+inline void write_pixels(
+    std::ostream &out, const ResolvedImage &image, ThreadPool *pool = nullptr
+) {
+  constexpr size_t BAND_ROWS = 16;
+
+  auto format_band = [&](size_t first, size_t last) {
+    std::string text;
+    text.reserve((last - first) * image.width * 12);
+    std::array<char, 8> digits{};
+    for (auto i = first * image.width * 3; i < last * image.width * 3; ++i) {
+      auto end = std::to_chars(digits.begin(), digits.end(), image.values[i]);
+      text.append(digits.begin(), end.ptr);
+      text += i % 3 == 2 ? '\n' : ' ';
+    }
+    return text;
+  };
+
+  if (pool == nullptr) {
+    out << format_band(0, image.height);
+    return;
+  }
+
+  std::vector<std::future<std::string>> bands;
+  for (size_t first = 0; first < image.height; first += BAND_ROWS)
+    bands.push_back(pool->submit([&, first] {
+      return format_band(first, std::min(first + BAND_ROWS, image.height));
+    }));
+  for (auto &band : bands)
+    band.wait();
+  for (auto &band : bands)
+    out << band.get();
+}
+
+// Outputs the PPM3 header of a `width`x`height` image, whose pixels follow
+// with `write_image_rows`.
+inline void write_image_header(
+    std::ostream &out, size_t width, size_t height,
+    const ResolveOptions &opts = {}
+) {
+  out << "P3\n" << width << ' ' << height << '\n' << opts.max_value() << '\n';
+}
+
+// Resolves and outputs the pixels of `rows`, starting at row `first_row` of
+// the image, so a large image can be written a band at a time.
+inline void write_image_rows(
+    std::ostream &out, std::span<const std::vector<Color>> rows,
+    size_t first_row, const ResolveOptions &opts = {},
+    ThreadPool *pool = nullptr
+) {
+  write_pixels(out, resolve_image(rows, opts, pool, first_row), pool);
+}
+
+// Resolves and outputs a whole image in the PPM3 image format.
+inline void write_image(
+    std::ostream &out, const std::vector<std::vector<Color>> &image,
+    const ResolveOptions &opts = {}, ThreadPool *pool = nullptr
+) {
+  write_image_header(
+      out, image.empty() ? 0 : image.front().size(), image.size(), opts
+  );
+  write_image_rows(out, image, 0, opts, pool);
+}
+
+#endif
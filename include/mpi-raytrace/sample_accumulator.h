@@ -0,0 +1,68 @@
+#ifndef SAMPLE_ACCUMULATOR_H
+#define SAMPLE_ACCUMULATOR_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "color.h"
+
+// Running sums of rendering passes over an image, for renders that keep
+// adding samples until a deadline. Passes always trace whole rows, so every
+// pixel of a row has the row's sample count.
+//
+// Rows may be added to concurrently as long as each row is only added to by
+// one thread at a time.
+class SampleAccumulator {
+  std::vector<std::vector<Color>> sums;
+  std::vector<uint32_t> counts;
+
+public:
+  explicit SampleAccumulator(size_t rows) : sums(rows), counts(rows) {}
+
+  // Adds a pass of `samples` rays per pixel whose per-pixel means are
+  // `means` to `row`. The row is allocated on first use, by the thread
+  // that renders it.
+  void add(size_t row, std::span<const Color> means, uint32_t samples) {
+    auto &sum = sums[row];
+    if (sum.empty())
+      sum.assign(means.size(), Color{0, 0, 0});
+    for (size_t i = 0; i < means.size(); ++i)
+      sum[i] += Color(means[i] * (double)samples);
+    counts[row] += samples;
+  }
+
+  [[nodiscard]] uint32_t samples(size_t row) const { return counts[row]; }
+
+  // The fewest and most samples any row has.
+  [[nodiscard]] std::pair<uint32_t, uint32_t> sample_range() const {
+    if (counts.empty())
+      return {0, 0};
+    auto [fewest, most] = std::ranges::minmax(counts);
+    return {fewest, most};
+  }
+
+  // The mean of the samples in `row` so far.
+  [[nodiscard]] std::vector<Color> mean(size_t row) const {
+    std::vector<Color> pixels(sums[row]);
+    auto scale = counts[row] > 0 ? 1.0 / counts[row] : 0.0;
+    for (auto &pixel : pixels)
+      pixel = Color(pixel * scale);
+    return pixels;
+  }
+
+  // Normalizes every row by its own sample count and returns the image.
+  [[nodiscard]] std::vector<std::vector<Color>> resolve() && {
+    for (size_t row = 0; row < sums.size(); ++row) {
+      auto scale = counts[row] > 0 ? 1.0 / counts[row] : 0.0;
+      for (auto &pixel : sums[row])
+        pixel = Color(pixel * scale);
+    }
+    return std::move(sums);
+  }
+};
+
+#endif
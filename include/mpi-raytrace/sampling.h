@@ -0,0 +1,99 @@
+#ifndef SAMPLING_H
+#define SAMPLING_H
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <numbers>
+#include <random>
+
+#include "utility.h"
+#include "vec.h"
+
+// Direction sampling for the path tracer. Every sampler returns the
+// direction together with its probability density per unit solid angle, so
+// estimators can divide by it and weigh strategies against each other.
+
+// Uniform numbers in [0, 1) for decisions along a path. `random_vec` steps
+// through one low discrepancy sequence per dimension, whose successive points
+// differ by a constant, so drawing from it at every vertex would tie the
+// vertices of a path together and bias the estimate.
+template <size_t D> [[nodiscard]] std::array<double, D> path_random() {
+  thread_local std::mt19937_64 engine(std::random_device{}());
+  std::uniform_real_distribution<double> distribution(0, 1);
+  std::array<double, D> res{};
+  for (auto &val : res)
+    val = distribution(engine);
+  return res;
+}
+
+struct DirectionSample {
+  Vec3 direction; // Unit length.
+  double pdf;
+};
+
+// Orthonormal basis around a unit vector `w`, after Duff et al., "Building
+// an Orthonormal Basis, Revisited".
+struct Onb {
+  Vec3 u, v, w;
+
+  explicit Onb(const Vec3 &normal) : w(normal) {
+    auto sign = std::copysign(1.0, w[2]);
+    auto a = -1.0 / (sign + w[2]);
+    auto b = w[0] * w[1] * a;
+    u = Vec3{1.0 + sign * w[0] * w[0] * a, sign * b, -sign * w[0]};
+    v = Vec3{b, sign + w[1] * w[1] * a, -w[1]};
+  }
+
+  [[nodiscard]] Vec3 local(double a, double b, double c) const {
+    return Vec3{a * u + b * v + c * w};
+  }
+};
+
+// Cosine weighted direction on the hemisphere around unit `normal`.
+[[nodiscard]] inline DirectionSample
+sample_cosine_hemisphere(const Vec3 &normal) {
+  auto [r1, r2] = path_random<2>();
+  auto phi = 2 * std::numbers::pi * r1;
+  auto sin_theta = std::sqrt(r2);
+  auto cos_theta = std::sqrt(std::max(0.0, 1 - r2));
+  return {
+      Onb(normal).local(
+          std::cos(phi) * sin_theta, std::sin(phi) * sin_theta, cos_theta
+      ),
+      cos_theta * std::numbers::inv_pi
+  };
+}
+
+[[nodiscard]] inline double
+cosine_hemisphere_pdf(const Vec3 &normal, const Vec3 &direction) {
+  return std::max(0.0, blaze::dot(normal, direction)) * std::numbers::inv_pi;
+}
+
+// Uniform direction within the cone around unit `axis` whose half angle has
+// cosine `cos_max`.
+[[nodiscard]] inline DirectionSample
+sample_cone(const Vec3 &axis, double cos_max) {
+  auto [r1, r2] = path_random<2>();
+  auto cos_theta = 1 - r1 * (1 - cos_max);
+  auto sin_theta = std::sqrt(std::max(0.0, 1 - cos_theta * cos_theta));
+  auto phi = 2 * std::numbers::pi * r2;
+  return {
+      Onb(axis).local(
+          std::cos(phi) * sin_theta, std::sin(phi) * sin_theta, cos_theta
+      ),
+      1 / (2 * std::numbers::pi * (1 - cos_max))
+  };
+}
+
+// Multiple importance sampling weight of a sample drawn with density
+// `chosen` when `other` could have produced it too (Veach's power
+// heuristic).
+[[nodiscard]] inline double power_heuristic(double chosen, double other) {
+  auto a = chosen * chosen;
+  auto b = other * other;
+  return a + b > 0 ? a / (a + b) : 0;
+}
+
+#endif
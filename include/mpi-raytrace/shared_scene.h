@@ -0,0 +1,148 @@
+#ifndef SHARED_SCENE_H
+#define SHARED_SCENE_H
+
+#include <algorithm>
+#include <bit>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <optional>
+#include <span>
+#include <stdexcept>
+
+#include <mpi.h>
+
+#include "flat_scene.h"
+#include "hittable.h"
+
+// One copy of a flat scene per node, shared by every rank on that node.
+//
+// Rank 0 builds the scene and broadcasts it to one leader rank per node.
+// Each leader owns an `MPI_Win_allocate_shared` window holding the scene,
+// and the other ranks of the node trace directly against the leader's
+// memory, so scene memory scales with nodes rather than ranks.
+class SharedScene {
+  MPI_Comm node_comm = MPI_COMM_NULL;   // Ranks sharing this node's memory.
+  MPI_Comm leader_comm = MPI_COMM_NULL; // Rank 0 of every node.
+  MPI_Win window = MPI_WIN_NULL;
+  std::optional<FlatSceneView> view;
+  int ranks_per_node = 1;
+
+  // Broadcasts `data` from rank 0 of `comm` in pieces MPI can count.
+  static void broadcast(std::span<std::byte> data, MPI_Comm comm) {
+    constexpr size_t CHUNK = size_t{1} << 30;
+    for (size_t offset = 0; offset < data.size(); offset += CHUNK) {
+      auto count = std::min(CHUNK, data.size() - offset);
+      MPI_Bcast(data.data() + offset, (int)count, MPI_BYTE, 0, comm);
+    }
+    static_assert(CHUNK <= INT_MAX);
+  }
+
+  // Frees whatever MPI objects have been created so far.
+  void release() noexcept {
+    view.reset();
+    if (window != MPI_WIN_NULL)
+      MPI_Win_free(&window);
+    if (leader_comm != MPI_COMM_NULL)
+      MPI_Comm_free(&leader_comm);
+    if (node_comm != MPI_COMM_NULL)
+      MPI_Comm_free(&node_comm);
+  }
+
+  // Splits `comm` into nodes, broadcasts the scene `build` returns on rank 0
+  // to one leader per node and maps it into every rank of the node.
+  void share(MPI_Comm comm, const std::function<FlatSceneBuffer()> &build) {
+    int rank{};
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_split_type(
+        comm, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL, &node_comm
+    );
+    int node_rank{};
+    MPI_Comm_rank(node_comm, &node_rank);
+    MPI_Comm_size(node_comm, &ranks_per_node);
+    MPI_Comm_split(
+        comm, node_rank == 0 ? 0 : MPI_UNDEFINED, rank, &leader_comm
+    );
+
+    // A size of zero tells the other ranks that the build failed.
+    FlatSceneBuffer scene;
+    std::exception_ptr failure;
+    if (rank == 0) {
+      try {
+        scene = build();
+      } catch (...) {
+        failure = std::current_exception();
+      }
+    }
+    uint64_t size = scene.size() * sizeof(FlatSceneBlock);
+    MPI_Bcast(&size, 1, MPI_UINT64_T, 0, comm);
+    if (failure)
+      std::rethrow_exception(failure);
+    if (size == 0)
+      throw std::runtime_error("Rank 0 failed to build the scene.");
+
+    // Windows need not be aligned for BVH nodes, so the leader allocates
+    // one block extra and tells the node where the aligned scene starts.
+    void *local = nullptr;
+    MPI_Win_allocate_shared(
+        node_rank == 0 ? (MPI_Aint)(size + sizeof(FlatSceneBlock)) : 0,
+        1,
+        MPI_INFO_NULL,
+        node_comm,
+        &local,
+        &window
+    );
+    MPI_Aint shared_size{};
+    int disp_unit{};
+    void *shared = nullptr;
+    MPI_Win_shared_query(window, 0, &shared_size, &disp_unit, &shared);
+    auto *base = static_cast<std::byte *>(shared);
+    uint64_t padding = 0;
+    if (node_rank == 0) {
+      constexpr auto ALIGNMENT = alignof(FlatSceneBlock);
+      padding = (ALIGNMENT - std::bit_cast<uintptr_t>(base) % ALIGNMENT) %
+                ALIGNMENT;
+    }
+    MPI_Bcast(&padding, 1, MPI_UINT64_T, 0, node_comm);
+    std::span bytes(base + padding, (size_t)size);
+
+    MPI_Win_fence(0, window);
+    if (leader_comm != MPI_COMM_NULL) {
+      if (rank == 0)
+        std::memcpy(bytes.data(), scene.data(), bytes.size());
+      broadcast(bytes, leader_comm);
+    }
+    MPI_Win_fence(0, window);
+
+    scene = {};
+    view.emplace(bytes);
+  }
+
+public:
+  // Collective over `comm`. `build` only runs on rank 0. If building or
+  // sharing the scene fails, everything created so far is freed.
+  SharedScene(MPI_Comm comm, const std::function<FlatSceneBuffer()> &build) {
+    try {
+      share(comm, build);
+    } catch (...) {
+      release();
+      throw;
+    }
+  }
+
+  ~SharedScene() { release(); }
+
+  SharedScene(const SharedScene &) = delete;
+  SharedScene(SharedScene &&) = delete;
+  SharedScene &operator=(const SharedScene &) = delete;
+  SharedScene &operator=(SharedScene &&) = delete;
+
+  [[nodiscard]] const Hittable &world() const { return *view; }
+  [[nodiscard]] size_t size_bytes() const { return view->size_bytes(); }
+  [[nodiscard]] int ranks_sharing() const noexcept { return ranks_per_node; }
+};
+
+#endif
@@ -7,26 +7,41 @@
 #include <optional>
 #include <utility>
 
+#include "aabb.h"
 #include "hittable.h"
 #include "interval.h"
+#include "lights.h"
+#include "material.h"
 #include "ray.h"
 #include "vec.h"
 
 // A sphere that can be ray traced against.
 class Sphere : public Hittable {
   Point3 sphere_center;
-  double radius;
+  double sphere_radius;
+  Material sphere_material;
 
 public:
   template <typename U>
     requires std::constructible_from<Point3, U>
-  Sphere(U &&center, double radius)
-      : sphere_center(std::forward<U>(center)), radius(std::max(0.0, radius)) {}
+  Sphere(U &&center, double radius, Material material = {})
+      : sphere_center(std::forward<U>(center)),
+        sphere_radius(std::max(0.0, radius)),
+        sphere_material(std::move(material)) {}
 
-  [[nodiscard]]
-  std::optional<HitRecord>
-  hit(const Ray &ray, Interval<double> ray_t) const override {
-    Vec3 ray_to_center = Vec3(sphere_center - ray.origin());
+  [[nodiscard]] const Point3 &center() const noexcept { return sphere_center; }
+  [[nodiscard]] double radius() const noexcept { return sphere_radius; }
+  [[nodiscard]] const Material &material() const noexcept {
+    return sphere_material;
+  }
+
+  // Intersects a ray with the sphere at `center` of `radius`.
+  [[gnu::hot]] [[nodiscard]]
+  static std::optional<HitRecord> intersect(
+      const Point3 &center, double radius, const Ray &ray,
+      Interval<double> ray_t
+  ) {
+    Vec3 ray_to_center = Vec3(center - ray.origin());
 
     auto a_normal_ray_direction = blaze::sqrNorm(ray.direction());
     auto b_ray_to_center = blaze::dot(ray.direction(), ray_to_center);
@@ -47,7 +62,29 @@ public:
     }
 
     return HitRecord::from_face_normal(
-        ray, root, Vec3((ray.at(root) - sphere_center) / radius)
+        ray, root, Vec3((ray.at(root) - center) / radius)
+    );
+  }
+
+  [[nodiscard]]
+  std::optional<HitRecord>
+  hit(const Ray &ray, Interval<double> ray_t) const override {
+    auto record = intersect(sphere_center, sphere_radius, ray, ray_t);
+    if (record.has_value())
+      record->material = &sphere_material;
+    return record;
+  }
+
+  void collect_lights(Lights &lights) const override {
+    if (sphere_material.emissive())
+      lights.add({sphere_center, sphere_radius, &sphere_material});
+  }
+
+  [[nodiscard]]
+  std::optional<AABB> bounding_box() const override {
+    auto extent = Vec3{sphere_radius, sphere_radius, sphere_radius};
+    return AABB::from_points(
+        Point3(sphere_center - extent), Point3(sphere_center + extent)
     );
   }
 };
@@ -0,0 +1,74 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// A fixed set of worker threads pulling tasks from one shared FIFO queue.
+class ThreadPool {
+  std::mutex mutex;
+  std::condition_variable has_work;
+  std::deque<std::move_only_function<void()>> tasks;
+  bool stopping = false;
+  std::vector<std::jthread> workers;
+
+  void work() {
+    for (;;) {
+      std::move_only_function<void()> task;
+      {
+        std::unique_lock lock(mutex);
+        has_work.wait(lock, [&] { return stopping || !tasks.empty(); });
+        if (tasks.empty())
+          return;
+        task = std::move(tasks.front());
+        tasks.pop_front();
+      }
+      task();
+    }
+  }
+
+public:
+  explicit ThreadPool(size_t n_threads) {
+    workers.reserve(n_threads);
+    for (size_t i = 0; i < n_threads; ++i)
+      workers.emplace_back([this] { work(); });
+  }
+
+  // Finishes every queued task before joining the workers.
+  ~ThreadPool() {
+    {
+      std::scoped_lock lock(mutex);
+      stopping = true;
+    }
+    has_work.notify_all();
+  }
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool(ThreadPool &&) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+  ThreadPool &operator=(ThreadPool &&) = delete;
+
+  [[nodiscard]] size_t size() const noexcept { return workers.size(); }
+
+  // Queues `func`. The future holds its result or exception.
+  template <typename F> auto submit(F &&func) {
+    std::packaged_task<std::invoke_result_t<F>()> task(std::forward<F>(func));
+    auto future = task.get_future();
+    {
+      std::scoped_lock lock(mutex);
+      tasks.emplace_back(std::move(task));
+    }
+    has_work.notify_one();
+    return future;
+  }
+};
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef TRACE_MPI_H
+#define TRACE_MPI_H
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <mpi.h>
+
+#include <fmt/format.h>
+
+#include "mpi_chunked.h"
+#include "trace.h"
+
+// Starts tracing on every rank of `comm` at the same moment, so timestamps
+// of different ranks line up as far as their clocks agree.
+inline void enable_trace(MPI_Comm comm) {
+  MPI_Barrier(comm);
+  Tracer::global().enable();
+}
+
+// Collects the events of every rank of `comm` on rank 0 and writes them to
+// `path` as one trace, with one process per rank.
+inline void write_trace(const std::string &path, MPI_Comm comm) {
+  int rank{}, size{};
+  MPI_Comm_rank(comm, &rank);
+  MPI_Comm_size(comm, &size);
+
+  auto local =
+      Tracer::global().json_events(rank, fmt::format("rank {}", rank));
+  uint64_t length = local.size();
+  std::vector<uint64_t> lengths(rank == 0 ? size : 0);
+  MPI_Gather(
+      &length, 1, MPI_UINT64_T, lengths.data(), 1, MPI_UINT64_T, 0, comm
+  );
+
+  // Events can outgrow an `int` count, so each rank sends them on its own.
+  if (rank != 0) {
+    send_chunked<char>(local, MPI_CHAR, 0, 0, comm);
+    return;
+  }
+  std::vector<std::string> parts(lengths.size());
+  parts[0] = std::move(local);
+  for (size_t i = 1; i < parts.size(); ++i) {
+    parts[i].resize(lengths[i]);
+    receive_chunked<char>(parts[i], MPI_CHAR, (int)i, 0, comm);
+  }
+  std::ofstream out(path);
+  if (!out)
+    throw std::runtime_error(fmt::format("Cannot write trace '{}'.", path));
+  write_trace(out, parts);
+}
+
+#endif
@@ -0,0 +1,173 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fmt/format.h>
+
+// A completed span on one thread, in nanoseconds since tracing started.
+struct TraceEvent {
+  const char *name; // Must be a string literal.
+  int64_t start_ns;
+  int64_t duration_ns;
+};
+
+// Fixed size ring of the latest events recorded by one thread. Only the
+// owning thread writes to it; it is read once that thread has finished.
+class TraceBuffer {
+public:
+  static constexpr size_t CAPACITY = size_t{1} << 16;
+
+private:
+  std::unique_ptr<TraceEvent[]> events =
+      std::make_unique<TraceEvent[]>(CAPACITY);
+  size_t recorded = 0; // Events ever pushed, including overwritten ones.
+  uint32_t thread_id;
+
+public:
+  explicit TraceBuffer(uint32_t thread_id) : thread_id(thread_id) {}
+
+  void push(const TraceEvent &event) noexcept {
+    events[recorded % CAPACITY] = event;
+    ++recorded;
+  }
+
+  [[nodiscard]] uint32_t id() const noexcept { return thread_id; }
+  [[nodiscard]] size_t dropped() const noexcept {
+    return recorded > CAPACITY ? recorded - CAPACITY : 0;
+  }
+
+  template <typename F> void for_each(F &&visit) const {
+    for (auto i = dropped(); i < recorded; ++i)
+      visit(events[i % CAPACITY]);
+  }
+};
+
+// Collects timeline spans from every thread of the process and writes them
+// in the Chrome trace event format, which chrome://tracing and Perfetto
+// load. Recording is disabled until `enable` and then costs a clock read and
+// a store into the thread's own buffer per span.
+class Tracer {
+  std::atomic<bool> active{false};
+  std::chrono::steady_clock::time_point epoch;
+  std::mutex mutex; // Guards `buffers`.
+  std::vector<std::unique_ptr<TraceBuffer>> buffers;
+
+public:
+  [[nodiscard]] static Tracer &global() {
+    static Tracer tracer;
+    return tracer;
+  }
+
+  // Starts recording. Timestamps count from this call.
+  void enable() {
+    epoch = std::chrono::steady_clock::now();
+    active.store(true, std::memory_order_release);
+  }
+
+  // Acquires what `enable` released, so a thread that sees tracing enabled
+  // also sees its `epoch`.
+  [[nodiscard]] bool enabled() const noexcept {
+    return active.load(std::memory_order_acquire);
+  }
+
+  [[nodiscard]] int64_t now_ns() const {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now() - epoch
+    )
+        .count();
+  }
+
+  // The calling thread's buffer, created on first use.
+  [[nodiscard]] TraceBuffer &local() {
+    thread_local TraceBuffer *buffer = nullptr;
+    if (buffer == nullptr) {
+      std::scoped_lock lock(mutex);
+      buffers.push_back(
+          std::make_unique<TraceBuffer>((uint32_t)buffers.size())
+      );
+      buffer = buffers.back().get();
+    }
+    return *buffer;
+  }
+
+  // The recorded events as comma separated JSON objects attributed to
+  // process `pid`, so several processes' events can be joined into one
+  // trace. Only call once the traced threads have finished.
+  [[nodiscard]] std::string json_events(int pid, std::string_view label) {
+    std::scoped_lock lock(mutex);
+    std::string out = fmt::format(
+        R"({{"name":"process_name","ph":"M","pid":{},)"
+        R"("args":{{"name":"{}"}}}})",
+        pid,
+        label
+    );
+    size_t dropped = 0;
+    for (const auto &buffer : buffers) {
+      dropped += buffer->dropped();
+      buffer->for_each([&](const TraceEvent &event) {
+        out += fmt::format(
+            R"(,{{"name":"{}","ph":"X","ts":{:.3f},"dur":{:.3f},)"
+            R"("pid":{},"tid":{}}})",
+            event.name,
+            (double)event.start_ns / 1e3,
+            (double)event.duration_ns / 1e3,
+            pid,
+            buffer->id()
+        );
+      });
+    }
+    if (dropped > 0)
+      out += fmt::format(
+          R"(,{{"name":"dropped_events","ph":"M","pid":{},)"
+          R"("args":{{"count":{}}}}})",
+          pid,
+          dropped
+      );
+    return out;
+  }
+};
+
+// Writes a complete trace from comma separated event lists.
+inline void
+write_trace(std::ostream &out, const std::vector<std::string> &parts) {
+  out << R"({"displayTimeUnit":"ms","traceEvents":[)";
+  for (size_t i = 0; i < parts.size(); ++i)
+    out << (i > 0 ? "," : "") << parts[i];
+  out << "]}\n";
+}
+
+// Records the lifetime of the enclosing scope as a span named `name`.
+class TraceSpan {
+  const char *name;
+  int64_t start_ns = -1; // Negative while tracing is disabled.
+
+public:
+  explicit TraceSpan(const char *name) : name(name) {
+    if (Tracer::global().enabled())
+      start_ns = Tracer::global().now_ns();
+  }
+
+  ~TraceSpan() {
+    if (start_ns < 0)
+      return;
+    auto &tracer = Tracer::global();
+    tracer.local().push({name, start_ns, tracer.now_ns() - start_ns});
+  }
+
+  TraceSpan(const TraceSpan &) = delete;
+  TraceSpan(TraceSpan &&) = delete;
+  TraceSpan &operator=(const TraceSpan &) = delete;
+  TraceSpan &operator=(TraceSpan &&) = delete;
+};
+
+#endif
@@ -0,0 +1,160 @@
+#ifndef TRIANGLE_MESH_H
+#define TRIANGLE_MESH_H
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include "aabb.h"
+#include "compact_bvh.h"
+#include "hittable.h"
+#include "interval.h"
+#include "ray.h"
+#include "vec.h"
+
+// An indexed triangle mesh. Vertices are shared between triangles and stored
+// in single precision; each triangle is three 32-bit indices into the vertex
+// buffer. The mesh accelerates over its own triangles with a `CompactBVH`
+// whose leaves reference contiguous runs of the (reordered) index buffer.
+class TriangleMesh : public Hittable {
+public:
+  using Vertex = std::array<float, 3>;
+  using Triangle = std::array<uint32_t, 3>;
+
+private:
+  std::vector<Vertex> vertices;
+  std::vector<Triangle> triangles;
+  CompactBVH<> bvh;
+
+  [[nodiscard]] Point3 vertex(uint32_t index) const {
+    const auto &v = vertices[index];
+    return Point3{(double)v[0], (double)v[1], (double)v[2]};
+  }
+
+  [[nodiscard]] AABB triangle_bounds(const Triangle &tri) const {
+    AABB box;
+    for (auto index : tri)
+      box.expand(vertices[index]);
+    return box;
+  }
+
+public:
+  TriangleMesh(std::vector<Vertex> vertices, std::vector<Triangle> triangles)
+      : vertices(std::move(vertices)), triangles(std::move(triangles)) {
+    for (const auto &tri : this->triangles)
+      for (auto index : tri)
+        if (index >= this->vertices.size())
+          throw std::out_of_range(fmt::format(
+              "Triangle index {} is out of range of {} vertices.",
+              index,
+              this->vertices.size()
+          ));
+
+    std::vector<AABB> bounds(this->triangles.size());
+    for (size_t i = 0; i < bounds.size(); ++i)
+      bounds[i] = triangle_bounds(this->triangles[i]);
+
+    // Store triangles in leaf order so every leaf is a contiguous run.
+    std::vector<uint32_t> order;
+    bvh = CompactBVH<>(bounds, order);
+    std::vector<Triangle> sorted(this->triangles.size());
+    for (size_t i = 0; i < order.size(); ++i)
+      sorted[i] = this->triangles[order[i]];
+    this->triangles = std::move(sorted);
+  }
+
+  // Möller–Trumbore ray/triangle intersection.
+  [[gnu::hot]] [[nodiscard]]
+  static std::optional<HitRecord> intersect(
+      const Point3 &v0, const Point3 &v1, const Point3 &v2, const Ray &ray,
+      Interval<double> ray_t
+  ) {
+    constexpr double EPSILON = 1e-12;
+
+    auto edge1 = Vec3(v1 - v0);
+    auto edge2 = Vec3(v2 - v0);
+
+    auto pvec = Vec3(blaze::cross(ray.direction(), edge2));
+    auto det = blaze::dot(edge1, pvec);
+    if (std::abs(det) < EPSILON)
+      return {};
+    auto inv_det = 1.0 / det;
+
+    auto tvec = Vec3(ray.origin() - v0);
+    auto u = blaze::dot(tvec, pvec) * inv_det;
+    if (u < 0.0 || u > 1.0)
+      return {};
+
+    auto qvec = Vec3(blaze::cross(tvec, edge1));
+    auto v = blaze::dot(ray.direction(), qvec) * inv_det;
+    if (v < 0.0 || u + v > 1.0)
+      return {};
+
+    auto time = blaze::dot(edge2, qvec) * inv_det;
+    if (!ray_t.surrounds(time))
+      return {};
+
+    return HitRecord::from_face_normal(
+        ray, time, Vec3(blaze::normalize(blaze::cross(edge1, edge2)))
+    );
+  }
+
+  [[nodiscard]] size_t vertex_count() const noexcept { return vertices.size(); }
+  [[nodiscard]] size_t triangle_count() const noexcept {
+    return triangles.size();
+  }
+
+  [[nodiscard]] std::span<const Vertex> vertex_data() const noexcept {
+    return vertices;
+  }
+  [[nodiscard]] std::span<const Triangle> triangle_data() const noexcept {
+    return triangles;
+  }
+
+  // A mesh without triangles has no bounds to give.
+  [[nodiscard]] std::optional<AABB> bounding_box() const override {
+    if (bvh.empty())
+      return {};
+    return bvh.bounds();
+  }
+
+  [[gnu::hot]] [[nodiscard]]
+  std::optional<HitRecord>
+  hit(const Ray &ray, Interval<double> ray_t) const override {
+    std::optional<HitRecord> result;
+
+    bvh.traverse(
+        ray,
+        ray_t,
+        [&](uint32_t first, uint32_t count, double &closest) {
+          for (auto i = first; i < first + count; ++i) {
+            const auto &tri = triangles[i];
+            auto record = intersect(
+                vertex(tri[0]),
+                vertex(tri[1]),
+                vertex(tri[2]),
+                ray,
+                Interval(ray_t.begin(), closest)
+            );
+            if (record.has_value()) {
+              closest = record->time;
+              result = std::move(*record);
+            }
+          }
+        }
+    );
+
+    return result;
+  }
+};
+
+#endif
@@ -2,6 +2,8 @@
 #define UTLITY_H
 
 #include <cassert>
+#include <charconv>
+#include <chrono>
 #include <cmath>
 #include <concepts>
 #include <cstdlib>
@@ -9,6 +11,8 @@
 #include <numbers>
 #include <random>
 #include <stdexcept>
+#include <string_view>
+#include <system_error>
 #include <utility>
 
 #include <fmt/format.h>
@@ -85,4 +89,27 @@ template <std::integral R, std::integral T>
   return static_cast<R>(value);
 }
 
+// Parses a positive duration such as "30s", "1.5m", "250ms" or "2h". Plain
+// numbers are seconds.
+[[nodiscard]] inline std::chrono::nanoseconds
+parse_duration(std::string_view text) {
+  double value{};
+  auto [end, err] =
+      std::from_chars(text.data(), text.data() + text.size(), value);
+  std::string_view unit(end, text.data() + text.size());
+  double seconds = unit == "ms"                  ? 1e-3
+                   : unit == "s" || unit.empty() ? 1
+                   : unit == "m"                 ? 60
+                   : unit == "h"                 ? 3600
+                                                 : 0;
+  if (err != std::errc{} || seconds == 0 || !std::isfinite(value) ||
+      value <= 0)
+    throw std::invalid_argument(fmt::format(
+        "Invalid duration '{}', expected e.g. 30s, 1.5m or 250ms.", text
+    ));
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::duration<double>(value * seconds)
+  );
+}
+
 #endif
\ No newline at end of file
@@ -0,0 +1,48 @@
+#ifndef VIEW_H
+#define VIEW_H
+
+#include <cmath>
+#include <cstddef>
+#include <stdexcept>
+
+#include "vec.h"
+
+// Where a camera is and what it looks at.
+struct View {
+  Point3 look_from{0, 0, 0};
+  Point3 look_at{0, 0, -1};
+  Vec3 up{0, 1, 0};
+  double vfov = 90; // Vertical field of view in degrees.
+
+  // Throws unless a camera basis can be built from the view: it looks
+  // somewhere, `up` is not along the view direction and the field of view
+  // lies within (0, 180) degrees.
+  void validate() const {
+    auto look_dir = Vec3(look_from - look_at);
+    auto side = blaze::norm(Vec3(blaze::cross(up, look_dir)));
+    if (!std::isfinite(side) ||
+        side <= 1e-9 * blaze::norm(up) * blaze::norm(look_dir) ||
+        !(vfov > 0 && vfov < 180))
+      throw std::invalid_argument(
+          "from and at must differ, up must not point along them and vfov "
+          "must lie between 0 and 180."
+      );
+  }
+};
+
+// A rectangle of pixels within the full image.
+struct Region {
+  size_t x = 0, y = 0;
+  size_t width = 0, height = 0;
+
+  // Whether the region is non-empty and lies within a `full_width` x
+  // `full_height` image, without overflowing on huge offsets.
+  [[nodiscard]] constexpr bool
+  fits_within(size_t full_width, size_t full_height) const noexcept {
+    return width != 0 && height != 0 && x < full_width &&
+           width <= full_width - x && y < full_height &&
+           height <= full_height - y;
+  }
+};
+
+#endif
@@ -0,0 +1,127 @@
+// Compares the specialized render kernels against the generic one.
+//
+// Usage: mpi-raytrace-bench [WIDTH HEIGHT]
+// Renders the built-in scene on one thread for a set of sample counts and
+// bounce depths. After a warmup render, each kernel renders `RUNS` times,
+// alternating with the other, and the median and range of the timings are
+// printed.
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include "bvh.h"
+#include "camera.h"
+#include "hittable_list.h"
+#include "material.h"
+#include "plane.h"
+#include "sphere.h"
+#include "vec.h"
+
+namespace {
+
+constexpr size_t RUNS = 5;
+
+// The scene `build_world` in main.cpp renders without meshes.
+BVH build_scene() {
+  HittableList world;
+  for (std::ptrdiff_t i = -2; i <= 2; i++) {
+    world.add(Sphere{Point3{-2, (double)i, -4}, 0.5});
+    world.add(Sphere{Point3{0, (double)i, -4}, 0.5});
+    world.add(Sphere{Point3{2, (double)i, -4}, 0.5});
+  }
+  world.add(Sphere{Point3{-1, 0, -4}, 0.5});
+  world.add(Plane{Point3{0, -2.5, 0}, Vec3{0, 1, 0}});
+  world.add(Sphere{
+      Point3{0, 4, -2}, 1, Material{Color{0, 0, 0}, Color{8, 8, 8}}
+  });
+  return BVH{std::move(world)};
+}
+
+// Seconds taken to render the whole image through `camera`.
+double time_render(Camera &camera, const Hittable &world) {
+  auto region = camera.full_region();
+  std::vector<std::vector<Color>> image(
+      region.height, std::vector<Color>(region.width)
+  );
+  auto start_time = std::chrono::steady_clock::now();
+  camera.render_rows(world, region, 0, region.height, image);
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start_time;
+  return elapsed.count();
+}
+
+// Median, fastest and slowest of `times`.
+struct Timing {
+  double median, min, max;
+
+  explicit Timing(std::vector<double> times) {
+    std::ranges::sort(times);
+    median = times[times.size() / 2];
+    min = times.front();
+    max = times.back();
+  }
+};
+
+} // namespace
+
+int main(int argc, char **argv) {
+  size_t width = 160, height = 90;
+  if (argc == 3) {
+    width = std::stoul(argv[1]);
+    height = std::stoul(argv[2]);
+  }
+
+  constexpr std::array<size_t, 3> SAMPLES{4, 16, 64};
+  constexpr std::array<size_t, 3> BOUNCES{2, 4, 8};
+
+  auto world = build_scene();
+  std::cout << fmt::format(
+      "{}x{}, 1 thread, median of {} runs (range)\n"
+      "{:>7} {:>7} {:>24} {:>24} {:>7}\n",
+      width,
+      height,
+      RUNS,
+      "samples",
+      "bounces",
+      "generic s",
+      "fixed s",
+      "speedup"
+  );
+  for (auto samples : SAMPLES) {
+    for (auto bounces : BOUNCES) {
+      Camera generic((double)width, (double)height, samples, bounces);
+      generic.use_generic_kernel();
+      Camera fixed((double)width, (double)height, samples, bounces);
+
+      (void)time_render(generic, world);
+      (void)time_render(fixed, world);
+      std::vector<double> generic_times, fixed_times;
+      for (size_t run = 0; run < RUNS; ++run) {
+        generic_times.push_back(time_render(generic, world));
+        fixed_times.push_back(time_render(fixed, world));
+      }
+      Timing generic_time(std::move(generic_times));
+      Timing fixed_time(std::move(fixed_times));
+      std::cout << fmt::format(
+          "{:>7} {:>7} {:>8.4f} ({:.4f}-{:.4f}) {:>8.4f} ({:.4f}-{:.4f}) "
+          "{:>6.2f}x\n",
+          samples,
+          bounces,
+          generic_time.median,
+          generic_time.min,
+          generic_time.max,
+          fixed_time.median,
+          fixed_time.min,
+          fixed_time.max,
+          generic_time.median / fixed_time.median
+      );
+    }
+  }
+}
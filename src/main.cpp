@@ -1,26 +1,50 @@
 // Source for core logic:
 // https://raytracing.github.io/books/RayTracingInOneWeekend.html
 
+#include <chrono>
 #include <cmath>
 #include <cstddef>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <memory>
+#include <optional>
+#include <stdexcept>
 #include <string>
 #include <thread>
+#include <utility>
+#include <vector>
 
 #include <cxxopts.hpp>
 #include <fmt/format.h>
 
 #ifdef USE_MPI
 #include "camera-mpi.h"
+#include "flat_scene.h"
+#include "shared_scene.h"
+#include "trace-mpi.h"
 #else
+#include "autotune.h"
 #include "camera.h"
+#include "live_framebuffer.h"
+#include "multi_view.h"
+#include "numa.h"
+#include "render_server.h"
+#include "thread_pool.h"
 #endif
 
+#include "bvh.h"
 #include "hittable_list.h"
+#include "material.h"
+#include "mesh_loader.h"
+#include "plane.h"
+#include "resolve.h"
 #include "sphere.h"
+#include "trace.h"
 #include "vec.h"
 
-HittableList build_world() {
+HittableList build_world(const std::vector<std::string> &mesh_paths) {
+  TraceSpan span("build scene");
   HittableList world;
 
   // Add spheres for "H"
@@ -42,7 +66,24 @@ HittableList build_world() {
     world.add(Sphere{Point3{2, (double)i, -4}, 0.5});
   }
 
-  world.add(Sphere{Point3{0, -102.5, -1}, 100});
+  // Ground, level with the bottom of the letters.
+  world.add(Plane{Point3{0, -2.5, 0}, Vec3{0, 1, 0}});
+
+  // Area light above the letters.
+  world.add(Sphere{
+      Point3{0, 4, -2}, 1, Material{Color{0, 0, 0}, Color{8, 8, 8}}
+  });
+
+  for (const auto &path : mesh_paths) {
+    auto mesh = load_obj(path);
+    std::clog << fmt::format(
+        "Loaded {} with {} vertices and {} triangles.\n",
+        path,
+        mesh.vertex_count(),
+        mesh.triangle_count()
+    );
+    world.add(std::move(mesh));
+  }
 
   return world;
 };
@@ -56,7 +97,88 @@ int main(int argc, char **argv) {
           "b,bounce",
           "Maximum number of times rays can bounce. Lower is faster but less accurate.",
           cxxopts::value<size_t>()->default_value("4")
-      )("t,threads", "Number of threads to use. Default is auto-detected from the CPU.", cxxopts::value<size_t>()->default_value(std::to_string(std::thread::hardware_concurrency())));
+      )("t,threads", "Number of threads to use. Default is auto-detected from the CPU.", cxxopts::value<size_t>()->default_value(std::to_string(std::thread::hardware_concurrency())))(
+          "m,mesh",
+          "Wavefront OBJ mesh to add to the scene. May be repeated.",
+          cxxopts::value<std::vector<std::string>>()
+      )(
+          "tone",
+          "Tone curve applied to the output: linear, gamma2 or srgb.",
+          cxxopts::value<std::string>()->default_value("gamma2")
+      )(
+          "bit-depth",
+          "Bits per output channel, 8 or 16.",
+          cxxopts::value<unsigned>()->default_value("8")
+      )("dither", "Apply an ordered dither when quantizing the output.")(
+          "reorder-rays",
+          "Trace a chunk's rays a bounce at a time, sorted by direction and "
+          "origin, for cache locality in large scenes."
+      )(
+          "time-budget",
+          "Keep adding passes of one ray per pixel until this much time, "
+          "e.g. 30s, 1.5m or 250ms, has passed. Replaces -r.",
+          cxxopts::value<std::string>()
+      )(
+          "trace",
+          "Record a timeline of the render and write it to this file in "
+          "Chrome trace format.",
+          cxxopts::value<std::string>()
+      );
+
+#ifdef USE_MPI
+  options.add_options()(
+      "shared-scene",
+      "Build the scene once on rank 0 and share one copy of it per node."
+  );
+#else
+  options.add_options()(
+      "serve",
+      "Keep running and accept render jobs on this Unix domain socket.",
+      cxxopts::value<std::string>()
+  )(
+      "crop",
+      "Only render the window x,y,width,height of the image and output it as "
+      "a partial image. May be repeated.",
+      cxxopts::value<std::vector<size_t>>()
+  )(
+      "views",
+      "Render every view listed in this file, one line of key=value pairs "
+      "each, in one pass over the scene, each to its own image.",
+      cxxopts::value<std::string>()
+  )(
+      "live-framebuffer",
+      "Publish the framebuffer of the render in progress to this POSIX "
+      "shared-memory segment, e.g. /mpi-raytrace.",
+      cxxopts::value<std::string>()
+  )(
+      "pin",
+      "Thread placement: none, compact (fill one NUMA node first), scatter "
+      "(round-robin over nodes) or an explicit CPU list such as 0-7,16-23.",
+      cxxopts::value<std::string>()->default_value("none")
+  )(
+      "replicate-scene",
+      "Build a copy of the scene on every NUMA node render threads are "
+      "pinned to."
+  )(
+      "chunk-rows",
+      "Number of rows a render thread takes at a time.",
+      cxxopts::value<size_t>()->default_value("1")
+  )(
+      "schedule",
+      "How threads split rows: dynamic (claim the next chunk) or "
+      "interleaved (fixed round-robin).",
+      cxxopts::value<std::string>()->default_value("dynamic")
+  )(
+      "autotune",
+      "Time short calibration renders to pick threads, chunk rows and "
+      "schedule, and remember them for this machine and scene."
+  )(
+      "tune-cache",
+      "File that tuned settings are kept in. Default is "
+      "~/.cache/mpi-raytrace/tune.tsv.",
+      cxxopts::value<std::string>()
+  );
+#endif
 
   auto args = options.parse(argc, argv);
 
@@ -65,26 +187,240 @@ int main(int argc, char **argv) {
   auto rays_per_pixel = args["rays"].as<size_t>();
   auto max_bounces = args["bounce"].as<size_t>();
   auto n_threads = args["threads"].as<size_t>();
+  ResolveOptions resolve_options{
+      parse_tone_curve(args["tone"].as<std::string>()),
+      args["bit-depth"].as<unsigned>(),
+      args["dither"].as<bool>()
+  };
+  resolve_options.validate();
+  auto mesh_paths = args.count("mesh") > 0
+                        ? args["mesh"].as<std::vector<std::string>>()
+                        : std::vector<std::string>{};
 
-  std::clog << fmt::format(
-      "Rendering a {}x{}px image with {} rays/px and {} max bounces.\n",
-      image_width,
-      image_height,
-      rays_per_pixel,
-      max_bounces
-  );
 #ifndef USE_MPI
-  std::clog << fmt::format("Using {} threads.\n", n_threads);
+  std::vector<ViewJob> views;
+  if (args.count("views") > 0) {
+    if (args.count("time-budget") > 0 || args.count("crop") > 0 ||
+        args.count("live-framebuffer") > 0)
+      throw std::invalid_argument(
+          "--views cannot be combined with --time-budget, --crop or "
+          "--live-framebuffer."
+      );
+    views = read_view_list(args["views"].as<std::string>());
+  }
+
+  if (args.count("serve") > 0) {
+    ThreadPool pool(n_threads);
+    SceneCache scenes([](const std::string &key) -> SceneCache::Scene {
+      std::vector<std::string> paths;
+      for (auto path : detail::split(key, ','))
+        paths.emplace_back(path);
+      return std::make_shared<const BVH>(build_world(paths));
+    });
+
+    RenderJob defaults;
+    defaults.width = image_width;
+    defaults.height = image_height;
+    defaults.rays_per_pixel = rays_per_pixel;
+    defaults.max_bounces = max_bounces;
+    defaults.resolve = resolve_options;
+    for (const auto &path : mesh_paths)
+      defaults.scene += (defaults.scene.empty() ? "" : ",") + path;
+
+    // Warm the cache with the scene given on the command line.
+    (void)scenes.get(defaults.scene);
+
+    RenderServer server(
+        args["serve"].as<std::string>(), pool, scenes, std::move(defaults)
+    );
+    server.run();
+  }
 #endif
 
+  std::optional<std::chrono::nanoseconds> time_budget;
+  if (args.count("time-budget") > 0)
+    time_budget = parse_duration(args["time-budget"].as<std::string>());
+
+  if (time_budget.has_value())
+    std::clog << fmt::format(
+        "Rendering a {}x{}px image for {} seconds with {} max bounces.\n",
+        image_width,
+        image_height,
+        std::chrono::duration<double>(*time_budget).count(),
+        max_bounces
+    );
+  else
+    std::clog << fmt::format(
+        "Rendering a {}x{}px image with {} rays/px and {} max bounces.\n",
+        image_width,
+        image_height,
+        rays_per_pixel,
+        max_bounces
+    );
+
+  auto configure = [&](Camera &camera) {
+    camera.resolve_with(resolve_options);
+    if (args["reorder-rays"].as<bool>())
+      camera.reorder_rays();
+    if (time_budget.has_value())
+      camera.render_for(*time_budget);
+  };
   Camera cam(
       (double)image_width, (double)image_height, rays_per_pixel, max_bounces
   );
-  auto world = build_world();
-
+  configure(cam);
 #ifdef USE_MPI
-  cam.render(world);
+  MPI_Init(nullptr, nullptr);
+  if (args.count("trace") > 0)
+    enable_trace(MPI_COMM_WORLD);
+  if (args["shared-scene"].as<bool>()) {
+    SharedScene scene(MPI_COMM_WORLD, [&] {
+      return flatten_scene(build_world(mesh_paths));
+    });
+    std::clog << fmt::format(
+        "Sharing a {} byte scene between {} ranks on this node.\n",
+        scene.size_bytes(),
+        scene.ranks_sharing()
+    );
+    cam.render(scene.world());
+  } else {
+    BVH world{build_world(mesh_paths)};
+    std::clog << fmt::format(
+        "Built BVH with {} nodes ({} bytes).\n",
+        world.node_count(),
+        world.memory_bytes()
+    );
+    cam.render(world);
+  }
+  if (args.count("trace") > 0)
+    write_trace(args["trace"].as<std::string>(), MPI_COMM_WORLD);
+  MPI_Finalize();
 #else
-  cam.render(world, n_threads);
+  if (args.count("trace") > 0)
+    Tracer::global().enable();
+  BVH world{build_world(mesh_paths)};
+  std::clog << fmt::format(
+      "Built BVH with {} nodes ({} bytes).\n",
+      world.node_count(),
+      world.memory_bytes()
+  );
+
+  auto numa = NumaTopology::detect();
+  auto pin_policy = args["pin"].as<std::string>();
+  RenderTuning tuning{
+      n_threads,
+      args["chunk-rows"].as<size_t>(),
+      parse_row_schedule(args["schedule"].as<std::string>())
+  };
+  TuneCache tune_cache(
+      args.count("tune-cache") > 0
+          ? std::filesystem::path(args["tune-cache"].as<std::string>())
+          : TuneCache::default_path()
+  );
+  auto machine = machine_signature(numa);
+  auto scene =
+      scene_signature(mesh_paths, world, cam.dimensions(), max_bounces);
+  if (args["autotune"].as<bool>()) {
+    auto result = autotune(
+        world, numa, pin_policy, cam.dimensions(), max_bounces
+    );
+    tuning = result.tuning;
+    tune_cache.store(machine, scene, result);
+    tune_cache.save();
+    std::clog << fmt::format(
+        "Saved tuned settings to {}.\n", tune_cache.file().string()
+    );
+  } else if (auto cached = tune_cache.find(machine, scene)) {
+    // Settings given on the command line win over tuned ones.
+    if (args.count("threads") == 0)
+      tuning.threads = cached->tuning.threads;
+    if (args.count("chunk-rows") == 0)
+      tuning.chunk_rows = cached->tuning.chunk_rows;
+    if (args.count("schedule") == 0)
+      tuning.schedule = cached->tuning.schedule;
+    std::clog << fmt::format(
+        "Using tuned settings from {}.\n", tune_cache.file().string()
+    );
+  }
+  n_threads = tuning.threads;
+  cam.schedule_rows(tuning.chunk_rows, tuning.schedule);
+  std::clog << fmt::format(
+      "Using {} threads with {} rows per chunk, {} schedule.\n",
+      n_threads,
+      tuning.chunk_rows,
+      to_string(tuning.schedule)
+  );
+
+  std::vector<Region> crops;
+  if (args.count("crop") > 0) {
+    auto values = args["crop"].as<std::vector<size_t>>();
+    if (values.size() % 4 != 0)
+      throw std::invalid_argument("--crop takes x,y,width,height.");
+    for (size_t i = 0; i < values.size(); i += 4)
+      crops.push_back(
+          {values[i], values[i + 1], values[i + 2], values[i + 3]}
+      );
+  }
+
+  std::unique_ptr<LiveFramebuffer> live_framebuffer;
+  if (args.count("live-framebuffer") > 0) {
+    constexpr size_t TILE_SIZE = 32;
+    live_framebuffer = std::make_unique<LiveFramebuffer>(
+        args["live-framebuffer"].as<std::string>(),
+        cam.dimensions()[0],
+        cam.dimensions()[1],
+        TILE_SIZE,
+        TILE_SIZE
+    );
+    cam.publish_to(live_framebuffer.get());
+  }
+
+  ThreadPlacement placement(numa, pin_policy, n_threads);
+  if (args["replicate-scene"].as<bool>()) {
+    if (!placement.pinned())
+      throw std::invalid_argument("--replicate-scene requires --pin.");
+    placement.replicate([&] {
+      return std::make_unique<const BVH>(build_world(mesh_paths));
+    });
+    std::clog << fmt::format(
+        "Replicated the scene on {} of {} NUMA nodes.\n",
+        placement.replica_count(),
+        placement.numa().node_count()
+    );
+  }
+  cam.place_threads(&placement);
+
+  if (views.empty()) {
+    cam.render(world, n_threads, crops);
+  } else {
+    std::vector<ViewTarget> targets;
+    for (auto &job : views) {
+      auto camera = std::make_unique<Camera>(
+          (double)image_width,
+          (double)image_height,
+          rays_per_pixel,
+          max_bounces,
+          job.view
+      );
+      configure(*camera);
+      targets.push_back({std::move(camera), std::move(job.output)});
+    }
+    render_views(
+        world,
+        targets,
+        n_threads,
+        tuning.chunk_rows,
+        tuning.schedule,
+        &placement
+    );
+  }
+
+  if (args.count("trace") > 0) {
+    auto path = args["trace"].as<std::string>();
+    std::ofstream trace(path);
+    if (!trace)
+      throw std::runtime_error(fmt::format("Cannot write trace '{}'.", path));
+    write_trace(trace, {Tracer::global().json_events(0, "mpi-raytrace")});
+  }
 #endif
 }
\ No newline at end of file
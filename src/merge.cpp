@@ -0,0 +1,85 @@
+// Assembles partial images rendered with `--crop` into the full frame.
+//
+// Usage: mpi-raytrace-merge [PARTIAL...] > image.ppm
+// Reads the partials from stdin when no files are given.
+
+#include <algorithm>
+#include <cstddef>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include "partial_image.h"
+
+int main(int argc, char **argv) {
+  std::vector<PartialImage> partials;
+  auto read = [&](std::istream &in) {
+    for (auto &partial : read_partial_images(in))
+      partials.push_back(std::move(partial));
+  };
+
+  if (argc < 2) {
+    read(std::cin);
+  } else {
+    for (int i = 1; i < argc; ++i) {
+      std::ifstream file(argv[i]);
+      if (!file)
+        throw std::runtime_error(fmt::format("Cannot open '{}'.", argv[i]));
+      read(file);
+    }
+  }
+
+  if (partials.empty())
+    throw std::runtime_error("No partial images to merge.");
+
+  const size_t width = partials.front().full_width;
+  const size_t height = partials.front().full_height;
+  const size_t max_value = partials.front().max_value;
+
+  std::vector<double> frame(width * height * 3);
+  std::vector<bool> covered(width * height);
+  for (const auto &partial : partials) {
+    const auto &region = partial.region;
+    if (partial.full_width != width || partial.full_height != height)
+      throw std::runtime_error(fmt::format(
+          "Partial of a {}x{} frame cannot merge into a {}x{} frame.",
+          partial.full_width,
+          partial.full_height,
+          width,
+          height
+      ));
+    if (partial.max_value != max_value)
+      throw std::runtime_error(fmt::format(
+          "Cannot merge partials with maximum values {} and {}.",
+          partial.max_value,
+          max_value
+      ));
+    if (!region.fits_within(width, height))
+      throw std::runtime_error("Partial is empty or lies outside its frame.");
+
+    for (size_t row = 0; row < region.height; ++row) {
+      for (size_t col = 0; col < region.width; ++col) {
+        auto pixel = (region.y + row) * width + region.x + col;
+        for (size_t channel = 0; channel < 3; ++channel)
+          frame[pixel * 3 + channel] =
+              partial.values[(row * region.width + col) * 3 + channel];
+        covered[pixel] = true;
+      }
+    }
+  }
+
+  auto missing = std::ranges::count(covered, false);
+  if (missing > 0)
+    std::clog << fmt::format(
+        "{} pixels were not covered and are black.\n", missing
+    );
+
+  std::cout << "P3\n" << width << ' ' << height << '\n' << max_value << '\n';
+  for (size_t pixel = 0; pixel < width * height; ++pixel)
+    std::cout << frame[pixel * 3] << ' ' << frame[pixel * 3 + 1] << ' '
+              << frame[pixel * 3 + 2] << '\n';
+}